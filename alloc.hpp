@@ -0,0 +1,138 @@
+#ifndef ALLOC_HPP
+#define ALLOC_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+
+// Allocation counting, compiled in with -DCOUNT_ALLOCATIONS. The global
+// operator new/delete are replaced by counting versions and every
+// ALLOC_SCOPE(...) in the chess core charges the allocations made while it
+// is active to its entry point. Without the flag ALLOC_SCOPE is empty.
+namespace Alloc{
+
+enum Scope{UpdateMoves, GetMoves, IsCovered, ScopeCount};
+
+const char* scopeNames[] = {"updateMoves", "getMoves", "isCovered"};
+
+struct Counters{
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<int64_t> live{0}; // bytes allocated and not freed yet
+};
+
+Counters total;
+Counters scopes[ScopeCount];
+
+// Nested and recursive scopes count each allocation once per entry point
+thread_local int activeScopes[ScopeCount];
+
+struct ScopeGuard{
+  Scope scope;
+  ScopeGuard(Scope scope) : scope(scope){
+    activeScopes[scope]++;
+    scopes[scope].calls.fetch_add(1, std::memory_order_relaxed);
+  }
+  ~ScopeGuard(){activeScopes[scope]--;}
+};
+
+void recordAllocation(size_t size){
+  total.allocations.fetch_add(1, std::memory_order_relaxed);
+  total.bytes.fetch_add(size, std::memory_order_relaxed);
+  total.live.fetch_add(size, std::memory_order_relaxed);
+  for(int s = 0; s < ScopeCount; s++){
+    if(!activeScopes[s]) continue;
+    scopes[s].allocations.fetch_add(1, std::memory_order_relaxed);
+    scopes[s].bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+}
+
+void recordFree(size_t size){total.live.fetch_sub(size, std::memory_order_relaxed);}
+
+// Kilobytes on Linux
+long peakRss(){
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+}
+
+#ifdef COUNT_ALLOCATIONS
+
+#define ALLOC_SCOPE(scope) Alloc::ScopeGuard allocScope(scope)
+
+// Each block carries its size 16 bytes before the pointer so frees can be
+// counted too. Over-aligned blocks get a header as large as their alignment.
+// Plain, array, nothrow and aligned forms all go through these two.
+namespace Alloc{
+
+void* allocate(size_t size, size_t alignment){
+  size_t header = std::max<size_t>(16, alignment);
+  void* block = nullptr;
+  if(alignment <= 16) block = std::malloc(size + header);
+  else if(posix_memalign(&block, alignment, size + header)) block = nullptr;
+  if(!block) return nullptr;
+  char* pointer = (char*)block + header;
+  *(size_t*)(pointer - 16) = size;
+  recordAllocation(size);
+  return pointer;
+}
+
+void release(void* pointer, size_t alignment){
+  if(!pointer) return;
+  recordFree(*(size_t*)((uintptr_t)pointer - 16));
+  std::free((void*)((uintptr_t)pointer - std::max<size_t>(16, alignment)));
+}
+
+}
+
+void* operator new(size_t size){
+  void* pointer = Alloc::allocate(size, 16);
+  if(!pointer) throw std::bad_alloc();
+  return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment){
+  void* pointer = Alloc::allocate(size, (size_t)alignment);
+  if(!pointer) throw std::bad_alloc();
+  return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{return Alloc::allocate(size, 16);}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+  return Alloc::allocate(size, (size_t)alignment);}
+
+void* operator new[](size_t size){return operator new(size);}
+void* operator new[](size_t size, std::align_val_t alignment){return operator new(size, alignment);}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{return Alloc::allocate(size, 16);}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+  return Alloc::allocate(size, (size_t)alignment);}
+
+void operator delete(void* pointer) noexcept{Alloc::release(pointer, 16);}
+void operator delete[](void* pointer) noexcept{Alloc::release(pointer, 16);}
+void operator delete(void* pointer, size_t) noexcept{Alloc::release(pointer, 16);}
+void operator delete[](void* pointer, size_t) noexcept{Alloc::release(pointer, 16);}
+void operator delete(void* pointer, const std::nothrow_t&) noexcept{Alloc::release(pointer, 16);}
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept{Alloc::release(pointer, 16);}
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept{Alloc::release(pointer, (size_t)alignment);}
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept{Alloc::release(pointer, (size_t)alignment);}
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept{Alloc::release(pointer, (size_t)alignment);}
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept{Alloc::release(pointer, (size_t)alignment);}
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+  Alloc::release(pointer, (size_t)alignment);}
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept{
+  Alloc::release(pointer, (size_t)alignment);}
+
+#else
+
+#define ALLOC_SCOPE(scope)
+
+#endif
+
+#endif
@@ -0,0 +1,112 @@
+// Allocation budget check for the chess core, built with -DCOUNT_ALLOCATIONS.
+// Generates moves the way the GUI does (Board::updateMoves) over a few
+// positions and a long random session, prints allocations and bytes per
+// entry point plus peak RSS, and exits nonzero when allocations per
+// generated move exceed the budget or the session leaks.
+//
+//   ./allocations --budget 1.5 --plies 20000
+
+#include <iostream>
+#include <random>
+#include <string>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "definitions.hpp"
+#include "chess.hpp"
+#include "notation.hpp"
+
+#ifndef COUNT_ALLOCATIONS
+#error "allocations.cpp needs -DCOUNT_ALLOCATIONS"
+#endif
+
+const char* POSITIONS[] = {
+  "rnbkqbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBKQBNR w",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w",
+  "3k4/6p1/1p6/8/3Q4/8/5p2/3K4 w",
+};
+
+typedef struct{
+  uint64_t calls, allocations, bytes;
+} Snapshot;
+
+Snapshot snapshot(Alloc::Counters& counters){
+  return {counters.calls.load(), counters.allocations.load(), counters.bytes.load()};
+}
+
+uint64_t generatedMoves(Chess::Board& board){
+  uint64_t count = 0;
+  for(auto& entry: board.moves) count += entry.second.size();
+  for(auto& entry: board.captureMoves) count += entry.second.size();
+  return count;
+}
+
+int main(int argc, char** argv){
+  double budget = 1.5;     // allocations per generated move in updateMoves
+  int plies = 20000;
+  int64_t leakBudget = 4096; // live bytes a whole session may keep
+  for(int i = 1; i + 1 < argc; i += 2){
+    std::string arg = argv[i];
+    if(arg == "--budget") budget = std::stod(argv[i + 1]);
+    else if(arg == "--plies") plies = std::stoi(argv[i + 1]);
+    else if(arg == "--leak") leakBudget = std::stoll(argv[i + 1]);
+    else{std::cerr << "Unknown option " << arg << "\n"; return 2;}
+  }
+
+  Chess::Board board;
+  uint64_t moves = 0;
+  Snapshot before[Alloc::ScopeCount], after[Alloc::ScopeCount];
+  for(int s = 0; s < Alloc::ScopeCount; s++) before[s] = snapshot(Alloc::scopes[s]);
+
+  for(const char* fen: POSITIONS){
+    Notation::loadFen(board, fen);
+    for(int i = 0; i < 100; i++){
+      board.updateMoves();
+      moves += generatedMoves(board);
+    }
+  }
+
+  // A long game session, every ply as the GUI plays it. The board is back
+  // to the start position at the end, anything still live is a leak.
+  std::mt19937 random(1);
+  board.reset();
+  int64_t liveBefore = Alloc::total.live.load();
+  for(int ply = 0; ply < plies; ply++){
+    std::vector<Chess::Move> legal = board.legalMoves();
+    if(legal.empty() || ply % 200 == 199){board.reset(); continue;}
+    Chess::Move move = legal[random() % legal.size()];
+    board.makeMove(move.piece, move.to);
+    board.switchTurn();
+    board.updateMoves();
+    moves += generatedMoves(board);
+  }
+  board.reset();
+  int64_t leaked = Alloc::total.live.load() - liveBefore;
+
+  for(int s = 0; s < Alloc::ScopeCount; s++) after[s] = snapshot(Alloc::scopes[s]);
+
+  std::cout << "Generated moves: " << moves << "\n";
+  for(int s = 0; s < Alloc::ScopeCount; s++){
+    uint64_t calls = after[s].calls - before[s].calls;
+    uint64_t allocations = after[s].allocations - before[s].allocations;
+    uint64_t bytes = after[s].bytes - before[s].bytes;
+    std::cout << "  " << Alloc::scopeNames[s] << ": " << calls << " calls, "
+	      << allocations << " allocations (" << (calls ? (double)allocations / calls : 0) << "/call), "
+	      << bytes << " bytes\n";
+  }
+  std::cout << "Total: " << Alloc::total.allocations.load() << " allocations, "
+	    << Alloc::total.bytes.load() << " bytes\n"
+	    << "Live after session: " << leaked << " bytes\n"
+	    << "Peak RSS: " << Alloc::peakRss() << " KB\n";
+
+  double perMove = (double)(after[Alloc::UpdateMoves].allocations - before[Alloc::UpdateMoves].allocations) / moves;
+  std::cout << "updateMoves allocations per generated move: " << perMove << " (budget " << budget << ")\n";
+
+  bool failed = false;
+  if(perMove > budget){std::cout << "FAIL: over the allocation budget\n"; failed = true;}
+  if(leaked > leakBudget){std::cout << "FAIL: session leaked " << leaked << " bytes\n"; failed = true;}
+  if(!failed) std::cout << "OK\n";
+  return failed ? 1 : 0;
+}
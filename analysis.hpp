@@ -0,0 +1,129 @@
+#ifndef ANALYSIS_HPP
+#define ANALYSIS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chess.hpp"
+#include "engine.hpp"
+
+namespace Analysis{
+
+// Single producer, single consumer ring buffer. One slot is kept empty to
+// tell a full queue from an empty one.
+template <typename T, size_t Capacity>
+struct SpscQueue{
+  std::array<T, Capacity> slots;
+  std::atomic<size_t> head{0}; // next slot to pop, owned by the consumer
+  std::atomic<size_t> tail{0}; // next slot to push, owned by the producer
+
+  bool push(T item){
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t next = (t + 1) % Capacity;
+    if(next == head.load(std::memory_order_acquire)) return false;
+    slots[t] = std::move(item);
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T& item){
+    size_t h = head.load(std::memory_order_relaxed);
+    if(h == tail.load(std::memory_order_acquire)) return false;
+    item = std::move(slots[h]);
+    head.store((h + 1) % Capacity, std::memory_order_release);
+    return true;
+  }
+};
+
+struct Info{
+  uint64_t generation = 0;
+  int depth = 0;
+  int score = 0; // side to move's point of view
+  Chess::PieceColor turn = Chess::White;
+  uint64_t nodes = 0;
+  uint64_t nps = 0;
+  double firstMoveCutoffRate = 0; // move ordering quality, 1 is perfect
+  std::vector<Chess::Move> pv;
+
+  int whiteScore(){return (turn == Chess::White) ? score : -score;}
+};
+
+// Analyzes the latest position handed to analyze() on its own thread and
+// streams one Info per completed iteration through `results`. Posting a new
+// position cancels the running search right away.
+struct Worker{
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  Chess::Board pending;
+  uint64_t generation = 0;
+  bool running = true;
+  std::atomic<bool> cancel{false};
+  int maxDepth = 32;
+
+  SpscQueue<Info, 64> results;
+
+  void start(){thread = std::thread(&Worker::loop, this);}
+
+  void analyze(Chess::Board& board){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending = board;
+      generation++;
+      cancel = true;
+    }
+    wake.notify_one();
+  }
+
+  void stop(){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+      cancel = true;
+    }
+    wake.notify_one();
+    if(thread.joinable()) thread.join();
+  }
+
+  void loop(){
+    uint64_t seen = 0;
+    while(true){
+      Chess::Board board;
+      {
+	std::unique_lock<std::mutex> lock(mutex);
+	wake.wait(lock, [&]{return !running || generation != seen;});
+	if(!running) return;
+	board = pending;
+	seen = generation;
+	cancel = false;
+      }
+
+      auto startTime = std::chrono::steady_clock::now();
+      Engine::Search search(board);
+      search.stop = &cancel;
+      search.onIteration = [&](Engine::Search& s){
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	Info info;
+	info.generation = seen;
+	info.depth = s.completedDepth;
+	info.score = s.bestScore;
+	info.turn = board.turn;
+	info.nodes = s.stats.nodes;
+	info.nps = (elapsed > 0) ? (uint64_t)(s.stats.nodes / elapsed) : 0;
+	info.firstMoveCutoffRate = s.stats.firstMoveCutoffRate();
+	info.pv = s.principalVariation();
+	results.push(std::move(info));
+      };
+      search.run(maxDepth);
+    }
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,428 @@
+// Batch PGN annotation: streams games, replays them on Chess::Board and
+// adds a score, a best move and a blunder mark to every move. Positions are
+// collected a batch of games at a time, deduplicated and searched on a
+// thread pool; results stay in a shared cache so openings and other
+// positions repeated across games are searched once.
+//
+//   ./annotate --input games.pgn --output annotated.pgn --nodes 5000 --threads 16
+//
+// The board can't play castling, en passant or promotion. Such games are
+// copied through unannotated with a warning naming the move that stopped
+// them; --strict makes the first one an error instead.
+
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "definitions.hpp"
+#include "chess.hpp"
+#include "engine.hpp"
+#include "notation.hpp"
+
+const std::string START_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w";
+
+struct Settings{
+  std::string inputPath;
+  std::string outputPath;
+  std::string networkPath;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  uint64_t nodes = 5000;
+  int batchGames = 512;
+  int cacheBits = 22;
+  bool strict = false;
+};
+
+/* ---------------- PGN reading ---------------- */
+
+typedef struct{
+  std::vector<std::string> tags; // whole tag lines
+  std::string movetext;
+  std::string raw;               // the game as read, for skipped games
+} PgnGame;
+
+struct PgnReader{
+  std::istream& in;
+  std::string pending;
+  bool hasPending = false;
+
+  PgnReader(std::istream& in) : in(in){}
+
+  bool getLine(std::string& line){
+    if(hasPending){line = pending; hasPending = false; return true;}
+    if(!std::getline(in, line)) return false;
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    return true;
+  }
+
+  // Reads tags up to the blank line, then movetext up to the next blank
+  // line or tag section
+  bool next(PgnGame& game){
+    game = {};
+    std::string line;
+    bool inMoves = false;
+    while(getLine(line)){
+      bool blank = line.find_first_not_of(" \t") == std::string::npos;
+      if(!inMoves){
+	if(blank) continue;
+	if(line[0] == '['){game.tags.push_back(line); game.raw += line + "\n"; continue;}
+	inMoves = true;
+	if(!game.tags.empty()) game.raw += "\n";
+      }
+      if(line[0] == '['){pending = line; hasPending = true; break;}
+      if(blank) break;
+      game.movetext += line + "\n";
+      game.raw += line + "\n";
+    }
+    return !game.tags.empty() || !game.movetext.empty();
+  }
+};
+
+std::string tagValue(PgnGame& game, std::string name){
+  std::string prefix = "[" + name + " \"";
+  for(auto& tag: game.tags)
+    if(tag.compare(0, prefix.size(), prefix) == 0){
+      size_t end = tag.find('"', prefix.size());
+      return tag.substr(prefix.size(), end == std::string::npos ? std::string::npos : end - prefix.size());
+    }
+  return "";
+}
+
+// SAN tokens of the main line and the result, comments, NAGs and variations dropped
+void splitMovetext(std::string& text, std::vector<std::string>& sans, std::string& result){
+  int depth = 0;
+  size_t i = 0;
+  while(i < text.size()){
+    char c = text[i];
+    if(c == '{'){i = text.find('}', i); if(i == std::string::npos) return; i++; continue;}
+    if(c == ';'){i = text.find('\n', i); if(i == std::string::npos) return; continue;}
+    if(c == '('){depth++; i++; continue;}
+    if(c == ')'){depth--; i++; continue;}
+    if(std::isspace((unsigned char)c)){i++; continue;}
+
+    size_t end = text.find_first_of(" \t\n{}();", i);
+    if(end == std::string::npos) end = text.size();
+    std::string token = text.substr(i, end - i);
+    i = end;
+    if(depth > 0 || token[0] == '$') continue;
+    if(token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*"){result = token; continue;}
+
+    // "12." "12..." and "12.e4"
+    size_t start = token.find_first_not_of("0123456789.");
+    if(start == std::string::npos) continue;
+    sans.push_back(token.substr(start));
+  }
+}
+
+/* ---------------- Analysis ---------------- */
+
+typedef struct{
+  int score;  // side to move's point of view
+  int depth;
+  bool hasMove;
+  Chess::Move move;
+} Evaluation;
+
+typedef struct{
+  uint64_t key;
+  std::vector<Chess::Piece> pieces;
+  Chess::PieceColor turn;
+} Position;
+
+// Direct-mapped like the engine's transposition table, only the batch
+// scheduler touches it so it needs no locking
+struct ResultCache{
+  typedef struct{
+    uint64_t key;
+    Evaluation evaluation;
+  } Entry;
+  std::vector<Entry> entries;
+  uint64_t hits = 0, lookups = 0;
+
+  ResultCache(int bits) : entries((size_t)1 << bits, Entry{0, {0, -1, false, {}}}){}
+
+  bool probe(uint64_t key, Evaluation& evaluation){
+    lookups++;
+    Entry& entry = entries[key & (entries.size() - 1)];
+    if(entry.key != key || entry.evaluation.depth < 0) return false;
+    evaluation = entry.evaluation;
+    hits++;
+    return true;
+  }
+
+  void store(uint64_t key, Evaluation& evaluation){
+    entries[key & (entries.size() - 1)] = {key, evaluation};
+  }
+};
+
+// `search` is the worker's own, reset for every position
+Evaluation analyze(Engine::Search& search, Chess::Board& board, uint64_t nodes){
+  search.reset(board);
+  if(board.legalMoves().empty())
+    return {board.isKingInCheck(board.turn) ? -Engine::MateScore : 0, 0, false, {}};
+
+  search.maxNodes = nodes;
+  search.run(Engine::MaxPly - 1);
+  return {search.bestScore, search.completedDepth, search.hasBestMove, search.bestMove};
+}
+
+typedef struct{
+  PgnGame pgn;
+  bool replayed;
+  std::vector<std::string> sans;
+  std::string result;
+  std::string startFen;
+  std::vector<Chess::Move> moves;
+  std::vector<uint64_t> keys; // one more than moves, the final position included
+  std::string unplayable;     // why replay failed, "12... O-O (castling)"
+} ReplayedGame;
+
+std::string unsupported(std::string& san){
+  if(san[0] == 'O' || san[0] == '0') return "castling";
+  if(san.find('=') != std::string::npos) return "promotion";
+  return "en passant or illegal";
+}
+
+bool replay(ReplayedGame& game, std::vector<Position>& positions){
+  splitMovetext(game.pgn.movetext, game.sans, game.result);
+  game.startFen = tagValue(game.pgn, "FEN");
+  if(game.startFen.empty()) game.startFen = START_FEN;
+
+  Chess::Board board;
+  if(!Notation::loadFen(board, game.startFen)){game.unplayable = "bad FEN " + game.startFen; return false;}
+  bool blackStarts = board.turn == Chess::Black;
+
+  size_t first = positions.size();
+  for(size_t i = 0; i <= game.sans.size(); i++){
+    game.keys.push_back(board.hash());
+    positions.push_back({board.hash(), board.pieces, board.turn});
+    if(i == game.sans.size()) break;
+
+    Chess::Move move;
+    if(!Notation::parseSan(board, game.sans[i], move)){
+      size_t ply = i + (blackStarts ? 1 : 0);
+      game.unplayable = std::to_string(ply / 2 + 1) + (ply % 2 ? "... " : ". ") +
+	game.sans[i] + " (" + unsupported(game.sans[i]) + ")";
+      positions.resize(first);
+      return false;
+    }
+    game.moves.push_back(move);
+    board.makeMove(move.piece, move.to);
+    board.switchTurn();
+  }
+  return true;
+}
+
+/* ---------------- Annotated output ---------------- */
+
+std::string scoreText(int score){
+  if(std::abs(score) > Engine::MateScore - Engine::MaxPly){
+    int plies = Engine::MateScore - std::abs(score);
+    return std::string(score > 0 ? "#" : "#-") + std::to_string((plies + 1) / 2);
+  }
+  char text[16];
+  snprintf(text, sizeof(text), "%+.2f", score / 100.0);
+  return text;
+}
+
+// Mate scores count as a large but finite swing when judging a move
+int clampScore(int score){return std::max(-2000, std::min(2000, score));}
+
+const char* mark(int loss){
+  if(loss >= 300) return "??";
+  if(loss >= 150) return "?";
+  if(loss >= 75) return "?!";
+  return "";
+}
+
+std::string annotated(ReplayedGame& game, std::unordered_map<uint64_t, Evaluation>& results, uint64_t nodes){
+  std::string text;
+  for(auto& tag: game.pgn.tags) text += tag + "\n";
+  text += "[Annotator \"simple-chess-with-sdl, " + std::to_string(nodes) + " nodes\"]\n\n";
+
+  Chess::Board board;
+  Notation::loadFen(board, game.startFen);
+  bool blackStarts = board.turn == Chess::Black;
+
+  std::string line;
+  for(size_t i = 0; i < game.moves.size(); i++){
+    Chess::Move& move = game.moves[i];
+    Evaluation& before = results[game.keys[i]];
+    Evaluation& after = results[game.keys[i + 1]];
+
+    // both from the mover's point of view
+    int best = clampScore(before.score), played = clampScore(-after.score);
+    int whiteScore = (board.turn == Chess::White) ? -after.score : after.score;
+
+    // the game ends on mate or stalemate, the SAN already says which
+    std::string comment;
+    if(after.hasMove){
+      comment = " {" + scoreText(whiteScore) + "/" + std::to_string(after.depth);
+      if(before.hasMove && !(before.move == move))
+	comment += " best " + Notation::san(board, before.move);
+      comment += "}";
+    }
+
+    size_t ply = i + (blackStarts ? 1 : 0);
+    std::string token;
+    if(ply % 2 == 0) token = std::to_string(ply / 2 + 1) + ". ";
+    else if(i == 0) token = std::to_string(ply / 2 + 1) + "... ";
+    token += Notation::san(board, move) + mark(best - played) + comment + " ";
+
+    if(line.size() + token.size() > 80){text += line + "\n"; line.clear();}
+    line += token;
+
+    board.makeMove(move.piece, move.to);
+    board.switchTurn();
+  }
+  return text + line + (game.result.empty() ? "*" : game.result) + "\n\n";
+}
+
+/* ---------------- Batches ---------------- */
+
+struct Totals{
+  uint64_t games = 0, skipped = 0, positions = 0, searched = 0;
+  Engine::Stats stats; // summed over every search
+};
+
+std::string describe(ReplayedGame& game, uint64_t number){
+  return "game " + std::to_string(number) + " (" + tagValue(game.pgn, "White") + " - " +
+    tagValue(game.pgn, "Black") + "): " + game.unplayable;
+}
+
+// False in strict mode when a game can't be replayed, before anything is searched
+bool runBatch(std::vector<ReplayedGame>& games, Settings& settings, NNUE::Network* network,
+	      ResultCache& cache, Totals& totals, std::ostream& out){
+  std::vector<Position> positions;
+  for(auto& game: games) game.replayed = replay(game, positions);
+
+  if(settings.strict)
+    for(size_t i = 0; i < games.size(); i++)
+      if(!games[i].replayed){
+	std::cerr << "Can't replay " << describe(games[i], totals.games + totals.skipped + i + 1) << "\n";
+	return false;
+      }
+
+  // every distinct position once, from the cache when it is there
+  std::unordered_map<uint64_t, Evaluation> results;
+  std::vector<Position*> work;
+  for(auto& position: positions){
+    totals.positions++;
+    if(results.count(position.key)){cache.lookups++; cache.hits++; continue;}
+    Evaluation evaluation;
+    if(cache.probe(position.key, evaluation)) results[position.key] = evaluation;
+    else{results[position.key] = {}; work.push_back(&position);}
+  }
+
+  std::vector<Evaluation> evaluations(work.size());
+  std::atomic<size_t> next{0};
+  std::mutex statsMutex;
+  auto worker = [&](){
+    Chess::Board board;
+    board.network = network;
+    Engine::Search search(board);
+    Engine::Stats stats;
+    for(size_t i = next++; i < work.size(); i = next++){
+      board.pieces = work[i]->pieces;
+      board.turn = work[i]->turn;
+      board.refreshAccumulator();
+      evaluations[i] = analyze(search, board, settings.nodes);
+      stats.nodes += search.stats.nodes;
+      stats.cutoffs += search.stats.cutoffs;
+      stats.firstMoveCutoffs += search.stats.firstMoveCutoffs;
+    }
+    std::lock_guard<std::mutex> lock(statsMutex);
+    totals.stats.nodes += stats.nodes;
+    totals.stats.cutoffs += stats.cutoffs;
+    totals.stats.firstMoveCutoffs += stats.firstMoveCutoffs;
+  };
+  std::vector<std::thread> threads;
+  for(int i = 0; i < settings.threads; i++) threads.emplace_back(worker);
+  for(auto& thread: threads) thread.join();
+
+  for(size_t i = 0; i < work.size(); i++){
+    results[work[i]->key] = evaluations[i];
+    cache.store(work[i]->key, evaluations[i]);
+  }
+  totals.searched += work.size();
+
+  for(auto& game: games){
+    if(game.replayed){out << annotated(game, results, settings.nodes); totals.games++;}
+    else{
+      totals.skipped++;
+      std::cerr << "skipped " << describe(game, totals.games + totals.skipped) << std::endl;
+      out << game.pgn.raw << "\n";
+    }
+  }
+  return true;
+}
+
+bool parseArguments(int argc, char** argv, Settings& settings){
+  for(int i = 1; i < argc; i++){
+    std::string arg = argv[i];
+    if(arg == "--strict"){settings.strict = true; continue;}
+    if(i + 1 >= argc){std::cerr << "Missing value for " << arg << "\n"; return false;}
+    std::string value = argv[++i];
+
+    if(arg == "--input") settings.inputPath = value;
+    else if(arg == "--output") settings.outputPath = value;
+    else if(arg == "--net") settings.networkPath = value;
+    else if(arg == "--threads") settings.threads = std::max(1, std::stoi(value));
+    else if(arg == "--nodes") settings.nodes = std::stoull(value);
+    else if(arg == "--batch") settings.batchGames = std::max(1, std::stoi(value));
+    else if(arg == "--cache-bits") settings.cacheBits = std::min(30, std::max(10, std::stoi(value)));
+    else{std::cerr << "Unknown option " << arg << "\n"; return false;}
+  }
+  if(settings.inputPath.empty() || settings.outputPath.empty()){
+    std::cerr << "Usage: annotate --input games.pgn --output annotated.pgn [--nodes N] [--threads N] [--strict]\n";
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv){
+  Settings settings;
+  if(!parseArguments(argc, argv, settings)) return 1;
+
+  std::ifstream input(settings.inputPath);
+  std::ofstream output(settings.outputPath);
+  if(!input || !output){std::cerr << "Cannot open input or output\n"; return 1;}
+
+  NNUE::Network* network = settings.networkPath.empty() ? nullptr : NNUE::load(settings.networkPath);
+  ResultCache cache(settings.cacheBits);
+  Totals totals;
+  PgnReader reader(input);
+  auto startTime = std::chrono::steady_clock::now();
+
+  std::vector<ReplayedGame> batch;
+  PgnGame pgn;
+  bool more = true;
+  while(more){
+    more = reader.next(pgn);
+    if(more){batch.push_back({}); batch.back().pgn = pgn;}
+    if(batch.empty() || (more && (int)batch.size() < settings.batchGames)) continue;
+
+    if(!runBatch(batch, settings, network, cache, totals, output)) return 1;
+    batch.clear();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::cerr << "games " << totals.games << "  skipped " << totals.skipped
+	      << "  positions/sec " << (uint64_t)(totals.positions / elapsed) << std::endl;
+  }
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  std::cout << "Games: " << totals.games << " annotated, " << totals.skipped << " skipped\n"
+	    << "Positions: " << totals.positions << " (" << totals.positions / elapsed << "/sec), "
+	    << totals.searched << " searched (" << totals.searched / elapsed << "/sec)\n"
+	    << "Nodes: " << totals.stats.nodes << ", first move cutoff rate "
+	    << 100 * totals.stats.firstMoveCutoffRate() << "%\n"
+	    << "Cache hit rate: " << (cache.lookups ? 100.0 * cache.hits / cache.lookups : 0) << "%\n"
+	    << "Time: " << elapsed << " s on " << settings.threads << " threads\n";
+  return 0;
+}
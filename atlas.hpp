@@ -0,0 +1,283 @@
+#ifndef ATLAS_HPP
+#define ATLAS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <SDL2/SDL_ttf.h>
+
+#include "definitions.hpp"
+
+// All sprites and the glyphs of the UI font packed into one texture,
+// pre-scaled to a level close to the current tile size so SDL_RenderCopy
+// barely scales. Each level is cached on disk as raw RGBA pixels keyed by a
+// hash of the source assets, so a warm start decodes no PNG and rasterizes
+// no glyph.
+namespace Atlas{
+
+const int Levels[] = {32, 48, 64, 96, 128, 192, 256, 384};
+const int LevelCount = sizeof(Levels) / sizeof(Levels[0]);
+
+const char FirstGlyph = 32;
+const char LastGlyph = 126;
+const int GlyphCount = LastGlyph - FirstGlyph + 1;
+
+const char* PiecesPath = "pieces.png";
+const char* TilesPath = "tiles.png";
+const char* FontPath = "./SpaceMono-Regular.ttf";
+const char* CacheDirectory = "atlas-cache";
+const uint32_t CacheVersion = 1;
+
+typedef struct{
+  SDL_Rect rect;
+  int advance;
+} Glyph;
+
+typedef struct{
+  char magic[4];
+  uint32_t version;
+  uint32_t width, height;
+  uint32_t level;
+  uint32_t glyphHeight;
+  Glyph glyphs[GlyphCount];
+} CacheHeader;
+
+
+uint64_t hashFile(const char* path, uint64_t hash){
+  std::ifstream file(path, std::ios::binary);
+  char buffer[4096];
+  while(file.read(buffer, sizeof(buffer)) || file.gcount() > 0){
+    for(std::streamsize i = 0; i < file.gcount(); i++){
+      hash ^= (uint8_t)buffer[i];
+      hash *= 0x100000001B3ULL;
+    }
+  }
+  return hash;
+}
+
+uint64_t assetHash(){
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  hash = hashFile(PiecesPath, hash);
+  hash = hashFile(TilesPath, hash);
+  return hashFile(FontPath, hash);
+}
+
+int levelFor(int tileSize){
+  for(int i = 0; i < LevelCount; i++) if(Levels[i] >= tileSize) return Levels[i];
+  return Levels[LevelCount - 1];
+}
+
+// Area-averaging downscale of src's srcRect into dst's dstRect, both RGBA32
+void downscale(SDL_Surface* src, SDL_Rect srcRect, SDL_Surface* dst, SDL_Rect dstRect){
+  for(int y = 0; y < dstRect.h; y++)
+    for(int x = 0; x < dstRect.w; x++){
+      int x0 = srcRect.x + x * srcRect.w / dstRect.w, x1 = srcRect.x + (x + 1) * srcRect.w / dstRect.w;
+      int y0 = srcRect.y + y * srcRect.h / dstRect.h, y1 = srcRect.y + (y + 1) * srcRect.h / dstRect.h;
+      if(x1 == x0) x1++;
+      if(y1 == y0) y1++;
+
+      // premultiplied so transparent pixels don't bleed their color
+      uint64_t sum[4] = {0, 0, 0, 0};
+      for(int sy = y0; sy < y1; sy++){
+	uint8_t* row = (uint8_t*)src->pixels + sy * src->pitch;
+	for(int sx = x0; sx < x1; sx++){
+	  uint8_t* p = row + sx * 4;
+	  sum[0] += p[0] * p[3]; sum[1] += p[1] * p[3]; sum[2] += p[2] * p[3]; sum[3] += p[3];
+	}
+      }
+      uint64_t count = (uint64_t)(x1 - x0) * (y1 - y0);
+      uint8_t* out = (uint8_t*)dst->pixels + (dstRect.y + y) * dst->pitch + (dstRect.x + x) * 4;
+      out[3] = sum[3] / count;
+      for(int c = 0; c < 3; c++) out[c] = sum[3] ? sum[c] / sum[3] : 0;
+    }
+}
+
+void copyPixels(SDL_Surface* src, SDL_Surface* dst, SDL_Rect at){
+  for(int y = 0; y < std::min(src->h, at.h); y++)
+    std::memcpy((uint8_t*)dst->pixels + (at.y + y) * dst->pitch + at.x * 4,
+		(uint8_t*)src->pixels + y * src->pitch, std::min(src->w, at.w) * 4);
+}
+
+SDL_Surface* loadRGBA(const char* path){
+  SDL_Surface* loaded = IMG_Load(path);
+  if(!loaded) return nullptr;
+  SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+  SDL_FreeSurface(loaded);
+  return converted;
+}
+
+struct Atlas{
+  SDL_Texture* texture = nullptr;
+  int level = 0;
+  int glyphHeight = 1;
+  int failedLevel = 0;  // its build failed, not retried
+  uint64_t assets = 0;  // assetHash(), computed once
+  Glyph glyphs[GlyphCount] = {};
+
+  // Layout: 6x2 pieces, then 3x2 tiles to their right, glyph rows below
+  SDL_Rect pieceRect(SDL_Point spritePosition){
+    return {spritePosition.x * level, spritePosition.y * level, level, level};}
+
+  SDL_Rect tileRect(int column, int row){
+    return {(6 + column) * level, row * level, level, level};}
+
+  std::string cachePath(uint64_t hash, int size){
+    char name[64];
+    snprintf(name, sizeof(name), "/%016llx-%d.raw", (unsigned long long)hash, size);
+    return CacheDirectory + std::string(name);
+  }
+
+  // Assembles the atlas from the loaded assets, which stay owned by build()
+  SDL_Surface* compose(int size, SDL_Surface* pieces, SDL_Surface* tiles, TTF_Font* glyphFont){
+    glyphHeight = TTF_FontHeight(glyphFont);
+
+    // pack glyphs in rows as wide as the sprite area
+    int width = 9 * size;
+    SDL_Point cursor = {0, 2 * size};
+    std::vector<SDL_Surface*> rendered(GlyphCount, nullptr);
+    for(int i = 0; i < GlyphCount; i++){
+      int minX, maxX, minY, maxY, advance;
+      TTF_GlyphMetrics(glyphFont, FirstGlyph + i, &minX, &maxX, &minY, &maxY, &advance);
+      SDL_Surface* glyph = TTF_RenderGlyph_Blended(glyphFont, FirstGlyph + i, {255, 255, 255, 255});
+      if(glyph){
+	rendered[i] = SDL_ConvertSurfaceFormat(glyph, SDL_PIXELFORMAT_RGBA32, 0);
+	SDL_FreeSurface(glyph);
+      }
+      int w = rendered[i] ? rendered[i]->w : advance;
+      if(cursor.x + w > width){cursor.x = 0; cursor.y += glyphHeight;}
+      glyphs[i] = {{cursor.x, cursor.y, w, glyphHeight}, advance};
+      cursor.x += w;
+    }
+    int height = cursor.y + glyphHeight;
+
+    SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+    if(atlas){
+      std::memset(atlas->pixels, 0, (size_t)atlas->pitch * height);
+      for(int y = 0; y < 2; y++)
+	for(int x = 0; x < 6; x++)
+	  downscale(pieces, {x * SPRITE_PIECE_SIZE, y * SPRITE_PIECE_SIZE, SPRITE_PIECE_SIZE, SPRITE_PIECE_SIZE},
+		    atlas, {x * size, y * size, size, size});
+      for(int y = 0; y < 2; y++)
+	for(int x = 0; x < 3; x++)
+	  downscale(tiles, {x * SPRITE_TILE_SIZE, y * SPRITE_TILE_SIZE, SPRITE_TILE_SIZE, SPRITE_TILE_SIZE},
+		    atlas, {(6 + x) * size, y * size, size, size});
+      for(int i = 0; i < GlyphCount; i++)
+	if(rendered[i]) copyPixels(rendered[i], atlas, glyphs[i].rect);
+    }
+
+    for(SDL_Surface* glyph: rendered) SDL_FreeSurface(glyph);
+    return atlas;
+  }
+
+  // nullptr if an asset is missing; whatever did load is freed either way
+  SDL_Surface* build(int size){
+    SDL_Surface* pieces = loadRGBA(PiecesPath);
+    SDL_Surface* tiles = loadRGBA(TilesPath);
+    TTF_Font* glyphFont = TTF_OpenFont(FontPath, std::max(8, size / 2));
+
+    SDL_Surface* atlas = nullptr;
+    if(pieces && tiles && glyphFont) atlas = compose(size, pieces, tiles, glyphFont);
+
+    SDL_FreeSurface(pieces);
+    SDL_FreeSurface(tiles);
+    if(glyphFont) TTF_CloseFont(glyphFont);
+    return atlas;
+  }
+
+  SDL_Surface* loadCache(std::string path, int size){
+    std::ifstream file(path, std::ios::binary);
+    CacheHeader header;
+    if(!file.read((char*)&header, sizeof(header))) return nullptr;
+    if(std::memcmp(header.magic, "ATLS", 4) != 0 || header.version != CacheVersion ||
+       header.level != (uint32_t)size) return nullptr;
+
+    SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, header.width, header.height, 32, SDL_PIXELFORMAT_RGBA32);
+    if(!atlas) return nullptr;
+    for(uint32_t y = 0; y < header.height; y++)
+      if(!file.read((char*)atlas->pixels + y * atlas->pitch, header.width * 4)){
+	SDL_FreeSurface(atlas);
+	return nullptr;
+      }
+    glyphHeight = header.glyphHeight;
+    std::memcpy(glyphs, header.glyphs, sizeof(glyphs));
+    return atlas;
+  }
+
+  void saveCache(std::string path, SDL_Surface* atlas, int size){
+    mkdir(CacheDirectory, 0755);
+    std::ofstream file(path, std::ios::binary);
+    CacheHeader header = {{'A', 'T', 'L', 'S'}, CacheVersion, (uint32_t)atlas->w, (uint32_t)atlas->h,
+			  (uint32_t)size, (uint32_t)glyphHeight, {}};
+    std::memcpy(header.glyphs, glyphs, sizeof(glyphs));
+    file.write((char*)&header, sizeof(header));
+    for(int y = 0; y < atlas->h; y++)
+      file.write((char*)atlas->pixels + y * atlas->pitch, atlas->w * 4);
+  }
+
+  // Switches to the level for `tileSize`, does nothing while the level stays the same
+  bool update(SDL_Renderer* renderer, int tileSize){
+    int size = levelFor(tileSize);
+    if((size == level && texture) || size == failedLevel) return false;
+
+    if(!assets) assets = assetHash();
+    std::string path = cachePath(assets, size);
+    SDL_Surface* atlas = loadCache(path, size);
+    if(!atlas){
+      atlas = build(size);
+      if(!atlas){failedLevel = size; return false;}
+      saveCache(path, atlas, size);
+    }
+
+    if(texture) SDL_DestroyTexture(texture);
+    texture = SDL_CreateTextureFromSurface(renderer, atlas);
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    SDL_FreeSurface(atlas);
+    level = size;
+    return true;
+  }
+
+  Glyph* glyph(char c){
+    if(c < FirstGlyph || c > LastGlyph) c = '?';
+    return &glyphs[c - FirstGlyph];
+  }
+
+  // Same contract as TTF_SizeText, in atlas pixels
+  void sizeText(const char* text, int* w, int* h){
+    *w = 0;
+    for(const char* c = text; *c; c++) *w += glyph(*c)->advance;
+    *h = glyphHeight;
+  }
+
+  // Stretches the text over `rect` like rendering a TTF texture into it would
+  void renderText(SDL_Renderer* renderer, const char* text, SDL_Color color, SDL_Rect* rect){
+    int w, h;
+    sizeText(text, &w, &h);
+    if(w == 0 || !texture) return;
+
+    SDL_SetTextureColorMod(texture, color.r, color.g, color.b);
+    int x = 0;
+    for(const char* c = text; *c; c++){
+      Glyph* g = glyph(*c);
+      SDL_Rect dst = {
+	rect->x + x * rect->w / w, rect->y,
+	g->rect.w * rect->w / w, rect->h};
+      RenderCopy(renderer, texture, &g->rect, &dst);
+      x += g->advance;
+    }
+    SDL_SetTextureColorMod(texture, 255, 255, 255);
+  }
+};
+
+}
+
+Atlas::Atlas atlas;
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+#include "definitions.hpp"
+
+// Timing and draw call counters for the headless rendering benchmark
+namespace Bench{
+
+typedef struct{
+  double seconds;
+  uint64_t drawCalls;
+} Section;
+
+struct FrameProfile{
+  Section tiles = {0, 0};
+  Section pieces = {0, 0};
+  Section buttons = {0, 0};
+  Section panels = {0, 0};
+  int frames = 0;
+};
+
+// Runs `render`, adding its time and draw calls to `section` when there is one
+template <typename F>
+void measure(Section* section, F render){
+  if(!section){render(); return;}
+  auto start = std::chrono::steady_clock::now();
+  uint64_t calls = drawCalls;
+  render();
+  section->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  section->drawCalls += drawCalls - calls;
+}
+
+// FNV-1a over the pixels of the current render target
+uint64_t frameChecksum(SDL_Renderer* renderer){
+  int w, h;
+  SDL_GetRendererOutputSize(renderer, &w, &h);
+  std::vector<uint32_t> pixels((size_t)w * h);
+  if(SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, pixels.data(), w * 4) != 0) return 0;
+
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for(uint32_t pixel: pixels)
+    for(int i = 0; i < 4; i++){
+      hash ^= (pixel >> (8 * i)) & 0xFF;
+      hash *= 0x100000001B3ULL;
+    }
+  return hash;
+}
+
+/* ---------------- Baselines ---------------- */
+
+typedef struct{
+  std::string scenario;
+  double framesPerSecond;
+  uint64_t checksum; // 0 when the run had no --checksum
+} Result;
+
+// One "scenario frames/sec checksum" line per result
+bool loadBaseline(std::string path, std::vector<Result>& results){
+  std::ifstream file(path);
+  if(!file) return false;
+  Result result;
+  while(file >> result.scenario >> result.framesPerSecond >> std::hex >> result.checksum >> std::dec)
+    results.push_back(result);
+  return !results.empty();
+}
+
+void saveBaseline(std::string path, std::vector<Result>& results){
+  std::ofstream file(path);
+  for(auto& result: results)
+    file << result.scenario << " " << result.framesPerSecond << " " << std::hex << result.checksum << std::dec << "\n";
+}
+
+void compare(std::vector<Result>& baseline, std::vector<Result>& results){
+  for(auto& result: results)
+    for(auto& base: baseline){
+      if(base.scenario != result.scenario) continue;
+      std::cout << result.scenario << ": " << base.framesPerSecond << " -> " << result.framesPerSecond
+		<< " frames/sec (" << std::showpos << 100.0 * (result.framesPerSecond / base.framesPerSecond - 1)
+		<< std::noshowpos << "%)";
+      if(base.checksum && result.checksum && base.checksum != result.checksum) std::cout << ", output changed";
+      std::cout << "\n";
+    }
+}
+
+// Delay from an input event until the first frame presented after it was
+// handled, which is the frame showing its effect. SDL stamps events in
+// milliseconds when they are queued, the rest is measured from the poll.
+struct InputLatency{
+  typedef struct{
+    double queuedMs;
+    std::chrono::steady_clock::time_point polled;
+  } Pending;
+
+  bool enabled = false;
+  double frameMs = 1000.0 / 60;
+  double reportSeconds = 5;
+  std::vector<Pending> pending;
+  std::vector<double> samples;
+  std::chrono::steady_clock::time_point lastReport = std::chrono::steady_clock::now();
+
+  void enable(SDL_Window* window){
+    enabled = true;
+    SDL_DisplayMode mode;
+    if(SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0) frameMs = 1000.0 / mode.refresh_rate;
+  }
+
+  void received(SDL_Event& event){
+    if(!enabled) return;
+    if(event.type != SDL_MOUSEBUTTONDOWN && event.type != SDL_MOUSEBUTTONUP && event.type != SDL_KEYDOWN) return;
+    pending.push_back({(double)(SDL_GetTicks() - event.common.timestamp), std::chrono::steady_clock::now()});
+  }
+
+  void presented(){
+    if(!enabled) return;
+    auto now = std::chrono::steady_clock::now();
+    for(auto& event: pending)
+      samples.push_back(event.queuedMs + std::chrono::duration<double, std::milli>(now - event.polled).count());
+    pending.clear();
+    if(std::chrono::duration<double>(now - lastReport).count() >= reportSeconds && !samples.empty()) report();
+  }
+
+  void report(){
+    if(!enabled || samples.empty()) return;
+    std::sort(samples.begin(), samples.end());
+    size_t late = samples.end() - std::upper_bound(samples.begin(), samples.end(), frameMs);
+    std::cout << "input latency: " << samples.size() << " events, p50 "
+	      << samples[samples.size() / 2] << " ms, p99 "
+	      << samples[std::min(samples.size() - 1, samples.size() * 99 / 100)] << " ms, max "
+	      << samples.back() << " ms, " << late << " over one frame (" << frameMs << " ms)" << std::endl;
+    samples.clear();
+    lastReport = std::chrono::steady_clock::now();
+  }
+};
+
+}
+
+#endif
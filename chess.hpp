@@ -1,10 +1,16 @@
 #ifndef CHESS_HPP
 #define CHESS_HPP
 
+#include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <map>
+#include <string>
 #include <tuple>
 
+#include "nnue.hpp"
+#include "alloc.hpp"
+
 namespace Chess{
   
 enum PieceName{Rook, Knight, Bishop, King, Queen, Pawn};
@@ -36,6 +42,46 @@ typedef struct{
 
 bool isWhite(SDL_Point p){return ((p.x + p.y) % 2 == 0);}
 
+int square(SDL_Point p){return p.x + 8*p.y;}
+
+// Where a piece is in pieces.png
+SDL_Point spritePositionOf(PieceName name, PieceColor color){
+  static const int column[] = {4, 3, 2, 0, 1, 5}; // indexed by PieceName
+  return {column[name], (color == White) ? 0 : 1};
+}
+
+typedef struct{
+  Piece piece;
+  SDL_Point to;
+} Move;
+
+bool operator==(Move const& a, Move const& b){
+  return a.piece.name == b.piece.name && a.piece.color == b.piece.color &&
+    a.piece.position == b.piece.position && a.to == b.to;}
+
+// Coordinate notation, file a is x = 0 and rank 1 is y = 0
+std::string squareName(SDL_Point p){
+  return std::string(1, (char)('a' + p.x)) + (char)('1' + p.y);}
+
+std::string moveName(Move move){
+  return squareName(move.piece.position) + squareName(move.to);}
+
+// Zobrist keys: one per (piece name, color, square), the last one for black to move
+constexpr uint64_t splitmix64(uint64_t x){
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+constexpr std::array<uint64_t, 6*2*64 + 1> makeZobristKeys(){
+  std::array<uint64_t, 6*2*64 + 1> keys = {};
+  for(size_t i = 0; i < keys.size(); i++) keys[i] = splitmix64(i);
+  return keys;
+}
+
+constexpr std::array<uint64_t, 6*2*64 + 1> zobristKeys = makeZobristKeys();
+
 const std::vector<Piece> initialPieces = {
   {Rook, White, {0, 0}, {4, 0}},
   {Rook, White, {7, 0}, {4, 0}},
@@ -79,11 +125,69 @@ const std::vector<Piece> initialPieces = {
   
   
   
+/* ---------------- Attack tables ---------------- */
+
+constexpr SDL_Point directions[8] = {
+  {0, 1}, {0, -1}, {1, 0}, {-1, 0}, // rook
+  {1, 1}, {1, -1}, {-1, 1}, {-1, -1}}; // bishop
+
+constexpr SDL_Point knightDeltas[8] = {
+  {2, 1}, {2, -1}, {-2, 1}, {-2, -1},
+  {1, 2}, {-1, 2}, {1, -2}, {-1, -2}};
+
+constexpr SDL_Point pawnCaptureDeltas[2][2] = {
+  {{-1, -1}, {1, -1}}, // Black
+  {{1, 1}, {-1, 1}}};  // White
+
+constexpr bool onBoard(int x, int y){return x >= 0 && x < 8 && y >= 0 && y < 8;}
+
+// On-board destinations of a leaper from every square
+struct Targets{
+  int count[64];
+  SDL_Point to[64][8];
+};
+
+constexpr Targets makeTargets(const SDL_Point* deltas, int size){
+  Targets targets = {};
+  for(int s = 0; s < 64; s++)
+    for(int i = 0; i < size; i++){
+      int x = s % 8 + deltas[i].x, y = s / 8 + deltas[i].y;
+      if(onBoard(x, y)) targets.to[s][targets.count[s]++] = {x, y};
+    }
+  return targets;
+}
+
+// Squares from every square to the edge along each of the 8 directions
+struct Rays{
+  int length[64][8];
+};
+
+constexpr Rays makeRays(){
+  Rays rays = {};
+  for(int s = 0; s < 64; s++)
+    for(int d = 0; d < 8; d++){
+      int x = s % 8 + directions[d].x, y = s / 8 + directions[d].y;
+      for(; onBoard(x, y); x += directions[d].x, y += directions[d].y) rays.length[s][d]++;
+    }
+  return rays;
+}
+
+constexpr Targets knightTargets = makeTargets(knightDeltas, 8);
+constexpr Targets kingTargets = makeTargets(directions, 8);
+constexpr Targets pawnCaptureTargets[2] = {
+  makeTargets(pawnCaptureDeltas[Black], 2),
+  makeTargets(pawnCaptureDeltas[White], 2)};
+constexpr Rays rays = makeRays();
+
+
 struct Board{
   std::vector<Piece> pieces = initialPieces;
   // Array2d<PieceType, 8, 8> board;
   PieceColor turn = White;
   std::map<Chess::Piece, std::vector<SDL_Point>> moves, captureMoves;
+
+  NNUE::Network* network = nullptr;
+  NNUE::Accumulator accumulator;
     
   Board(){
     updateMoves();
@@ -96,6 +200,7 @@ struct Board{
   void reset(){
     pieces = initialPieces;
     turn = White;
+    refreshAccumulator();
     updateMoves();
   }
 
@@ -125,250 +230,338 @@ struct Board{
 	pieces.erase(pieces.begin() + i); break;}
   }
 
-  void makeMove(Piece piece, SDL_Point position){
+  // Moves the piece without touching the accumulator, for trial moves
+  // that are undone by restoring `pieces`
+  void movePiece(Piece piece, SDL_Point position){
     set(piece, position);
     deletePieceAt(piece.position);
   }
-  
-  std::vector<SDL_Point> getPawnMoves(SDL_Point p, PieceColor color){
-    std::vector<SDL_Point> moves = {};
-    if(color == White){
-      if(p.y == 7) return {};
-      if(!any({p.x, p.y + 1})) moves.push_back({p.x, p.y + 1});
-      if((p.y == 1) && !any({p.x, 2}) && !any({p.x, 3}))
-	moves.push_back({p.x, 3});
-    }
-    else{
-      if(p.y == 0) return {};
-      if(!any({p.x, p.y - 1})) moves.push_back({p.x, p.y - 1});
-      if((p.y == 6) && !any({p.x, 5}) && !any({p.x, 4}))
-	moves.push_back({p.x, 4});
-    
-    }
-    return moves;
+
+  void makeMove(Piece piece, SDL_Point position){
+    if(!network){movePiece(piece, position); return;}
+
+    bool captured = any(position);
+    Piece victim = (*this)[position];
+    bool refresh = piece.name == King || (captured && victim.name == King);
+
+    if(!refresh)
+      for(PieceColor perspective: {Black, White}){
+	SDL_Point king = kingPosition(perspective);
+	if(king.x < 0) continue;
+	Piece moved = piece; moved.position = position;
+	NNUE::remove(*network, accumulator, perspective, featureIndex(piece, perspective, king));
+	NNUE::add(*network, accumulator, perspective, featureIndex(moved, perspective, king));
+	if(captured)
+	  NNUE::remove(*network, accumulator, perspective, featureIndex(victim, perspective, king));
+      }
+
+    movePiece(piece, position);
+    if(refresh) refreshAccumulator();
   }
 
-  bool is(SDL_Point p){
-    return SDL_PointInRect(&p, new SDL_Rect({0, 0, 8, 8}));}
-  
-  std::vector<SDL_Point> getRookMoves(SDL_Point p){
-    std::vector<SDL_Point> moves = {};
-    SDL_Point to;
-    for(int d = 1; d < 8; d++){
-      to = {p.x, p.y + d}; if(is(to) && !any(to)) moves.push_back(to); else break;}
-    for(int d = 1; d < 8; d++){
-      to = {p.x, p.y - d}; if(is(to) && !any(to)) moves.push_back(to); else break;}
-    for(int d = 1; d < 8; d++){
-      to = {p.x + d, p.y}; if(is(to) && !any(to)) moves.push_back(to); else break;}
-    for(int d = 1; d < 8; d++){
-      to = {p.x - d, p.y}; if(is(to) && !any(to)) moves.push_back(to); else break;}
+  // Reverts makeMove: `piece` now stands on the square it moved to. The
+  // accumulator gets the inverse update, king moves refresh like in makeMove.
+  void unmakeMove(Piece piece, SDL_Point from, bool captured, Piece victim){
+    bool refresh = piece.name == King || (captured && victim.name == King);
+
+    if(network && !refresh)
+      for(PieceColor perspective: {Black, White}){
+	SDL_Point king = kingPosition(perspective);
+	if(king.x < 0) continue;
+	Piece restored = piece; restored.position = from;
+	NNUE::remove(*network, accumulator, perspective, featureIndex(piece, perspective, king));
+	NNUE::add(*network, accumulator, perspective, featureIndex(restored, perspective, king));
+	if(captured)
+	  NNUE::add(*network, accumulator, perspective, featureIndex(victim, perspective, king));
+      }
+
+    movePiece(piece, from);
+    if(captured) set(victim, victim.position);
+    if(refresh) refreshAccumulator();
+  }
 
-    return moves;
+  uint64_t hash(){
+    uint64_t key = (turn == Black) ? zobristKeys[6*2*64] : 0;
+    for(auto& piece: pieces)
+      key ^= zobristKeys[(piece.name*2 + piece.color)*64 + square(piece.position)];
+    return key;
   }
-  
-  std::vector<SDL_Point> getBishopMoves(SDL_Point p){
-    std::vector<SDL_Point> moves = {};
-    SDL_Point to;
-    for(int d = 1; d < 8; d++){
-      to = {p.x + d, p.y + d}; if(is(to) && !any(to)) moves.push_back(to); else break;}
-    for(int d = 1; d < 8; d++){
-      to = {p.x + d, p.y - d}; if(is(to) && !any(to)) moves.push_back(to); else break;}
-    for(int d = 1; d < 8; d++){
-      to = {p.x - d, p.y + d}; if(is(to) && !any(to)) moves.push_back(to); else break;}
-    for(int d = 1; d < 8; d++){
-      to = {p.x - d, p.y - d}; if(is(to) && !any(to)) moves.push_back(to); else break;}
 
-    return moves;
+  /* ---------------- Static exchange ---------------- */
+
+  uint64_t occupancy(){
+    uint64_t occupied = 0;
+    for(auto& piece: pieces) occupied |= 1ULL << square(piece.position);
+    return occupied;
   }
 
+  // Whether nothing in `occupied` stands strictly between a and b on a line
+  bool isRayClear(SDL_Point a, SDL_Point b, uint64_t occupied){
+    SDL_Point step = {(b.x > a.x) - (b.x < a.x), (b.y > a.y) - (b.y < a.y)};
+    for(SDL_Point p = a + step; !(p == b); p = p + step)
+      if(occupied & (1ULL << square(p))) return false;
+    return true;
+  }
 
-  std::vector<SDL_Point> getQueenMoves(SDL_Point& position){
-    std::vector<SDL_Point> moves = getRookMoves(position);
-    std::vector<SDL_Point> diagonalMoves = getBishopMoves(position);
-    moves.insert(moves.end(), diagonalMoves.begin(), diagonalMoves.end());
-    return moves;
+  bool attacks(Piece& piece, SDL_Point target, uint64_t occupied){
+    int dx = target.x - piece.position.x, dy = target.y - piece.position.y;
+    int ax = std::abs(dx), ay = std::abs(dy);
+    if(ax == 0 && ay == 0) return false;
+
+    switch(piece.name){
+    case Pawn: return ax == 1 && dy == ((piece.color == White) ? 1 : -1);
+    case Knight: return (ax == 1 && ay == 2) || (ax == 2 && ay == 1);
+    case King: return ax <= 1 && ay <= 1;
+    case Rook: return (ax == 0 || ay == 0) && isRayClear(piece.position, target, occupied);
+    case Bishop: return ax == ay && isRayClear(piece.position, target, occupied);
+    case Queen:
+      return (ax == 0 || ay == 0 || ax == ay) && isRayClear(piece.position, target, occupied);
+    }
+    return false;
   }
 
-  std::vector<SDL_Point> getKnightMoves(SDL_Point& p){
-    std::vector<SDL_Point> moves = {};
-    std::vector<SDL_Point> knightDeltas = {
-      {2, 1}, {2, -1}, {-2, 1}, {-2, -1},
-      {1, 2}, {-1, 2}, {1, -2}, {-1, -2}};
-    SDL_Point to;
-    for(auto d: knightDeltas){
-      to = p + d; if(is(to) && !any(to)) moves.push_back(to);}
-    return moves;
+  // Cheapest piece of `color` in `occupied` attacking `target`. Sliders are
+  // checked against `occupied`, so pieces removed from it uncover x-rays.
+  bool leastValuableAttacker(SDL_Point target, PieceColor color, uint64_t occupied, Piece& attacker){
+    bool found = false;
+    for(auto& piece: pieces){
+      if(piece.color != color || !(occupied & (1ULL << square(piece.position)))) continue;
+      if(found && pieceValue(piece.name) >= pieceValue(attacker.name)) continue;
+      if(attacks(piece, target, occupied)){attacker = piece; found = true;}
+    }
+    return found;
   }
-  
-  std::vector<SDL_Point> getAllKingMoves(SDL_Point& p){
-    std::vector<SDL_Point> moves = {};
 
-    SDL_Point kingDeltas[8] = {
-      {-1, -1}, {1, 1}, {1, -1}, {-1, 1}, {0, 1}, {1, 0}, {0, -1}, {-1, 0}};
+  // Net material won by the side making `move` once every piece has taken
+  // part in the exchange on its target square, without making any move.
+  int see(Move move){
+    int gain[32];
+    int depth = 0;
+    uint64_t occupied = occupancy();
+
+    gain[0] = any(move.to) ? pieceValue((*this)[move.to].name) : 0;
+    int lastValue = pieceValue(move.piece.name);
+    occupied &= ~(1ULL << square(move.piece.position));
+    PieceColor side = !move.piece.color;
+
+    Piece attacker = {};
+    while(depth < 31 && leastValuableAttacker(move.to, side, occupied, attacker)){
+      depth++;
+      gain[depth] = lastValue - gain[depth - 1];
+      lastValue = pieceValue(attacker.name);
+      occupied &= ~(1ULL << square(attacker.position));
+      side = !side;
+    }
 
-    SDL_Point to;
-    for(auto d: kingDeltas){
-      to = p + d; if(is(to) && !any(to)) moves.push_back(to);}
+    for(; depth > 0; depth--) gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+    return gain[0];
+  }
 
-    return moves;
+  SDL_Point kingPosition(PieceColor color){
+    for(auto& piece: pieces)
+      if(piece.name == King && piece.color == color) return piece.position;
+    return {-1, -1};
+  }
+
+  /* ---------------- Evaluation ---------------- */
+
+  // HalfKP feature of `piece` as seen by `perspective` whose king is on `king`.
+  // Black sees the board flipped vertically.
+  int featureIndex(Piece piece, PieceColor perspective, SDL_Point king){
+    static const int kind[] = {0, 1, 2, -1, 3, 4}; // indexed by PieceName
+    int flip = (perspective == White) ? 0 : 56;
+    int kingSquare = (king.x + 8*king.y) ^ flip;
+    int square = (piece.position.x + 8*piece.position.y) ^ flip;
+    int pieceKind = 2*kind[piece.name] + (piece.color == perspective ? 0 : 1);
+    return (kingSquare * NNUE::PieceKinds + pieceKind) * NNUE::Squares + square;
   }
 
-  std::vector<SDL_Point> getPawnCaptureMoves(SDL_Point& p, PieceColor color){
-    std::vector<SDL_Point> moves;
-    SDL_Point to;
-    if(color == White){
-      to = p + (SDL_Point){1, 1};
-      if(any(to) && ((*this)[to].color != color)) moves.push_back(to);
-      to = p + (SDL_Point){-1, 1};
-      if(any(to) && ((*this)[to].color != color)) moves.push_back(to);
-    }else{
-      to = p + (SDL_Point){-1, -1};
-      if(any(to) && ((*this)[to].color != color)) moves.push_back(to);
-      to = p + (SDL_Point){1, -1};
-      if(any(to) && ((*this)[to].color != color)) moves.push_back(to);
+  void refreshAccumulator(){
+    if(!network) return;
+    for(PieceColor perspective: {Black, White}){
+      NNUE::reset(*network, accumulator, perspective);
+      SDL_Point king = kingPosition(perspective);
+      if(king.x < 0) continue;
+      for(auto& piece: pieces)
+	if(piece.name != King)
+	  NNUE::add(*network, accumulator, perspective, featureIndex(piece, perspective, king));
     }
-    return moves;
   }
 
+  void setNetwork(NNUE::Network* net){
+    network = net;
+    refreshAccumulator();
+  }
 
-  std::vector<SDL_Point> getPawnPossibleCaptureMoves(SDL_Point& p, PieceColor color){
-    std::vector<SDL_Point> moves;
-    SDL_Point to;
-    if(color == White){
-      to = p + (SDL_Point){1, 1};
-      moves.push_back(to);
-      to = p + (SDL_Point){-1, 1};
-      moves.push_back(to);
-    }else{
-      to = p + (SDL_Point){-1, -1};
-      moves.push_back(to);
-      to = p + (SDL_Point){1, -1};
-      moves.push_back(to);
+  int pieceValue(PieceName name){
+    switch(name){
+    case Pawn: return 100;
+    case Knight: return 300;
+    case Bishop: return 300;
+    case Rook: return 500;
+    case Queen: return 900;
+    case King: return 20000;
     }
-    return moves;
+    return 0;
   }
 
-  std::vector<SDL_Point> getRookCaptureMoves(SDL_Point p, PieceColor color){
-    std::vector<SDL_Point> moves = {};
-    SDL_Point to;
-    for(int d = 1; d < 8; d++){
-      to = {p.x, p.y + d};
-      if(is(to) && any(to)){if((*this)[to].color != color) moves.push_back(to);break;}}
-    for(int d = 1; d < 8; d++){
-      to = {p.x, p.y - d};
-      if(is(to) && any(to)){if((*this)[to].color != color) moves.push_back(to);break;}}
-    for(int d = 1; d < 8; d++){
-      to = {p.x + d, p.y};
-      if(is(to) && any(to)){if((*this)[to].color != color) moves.push_back(to);break;}}
-    for(int d = 1; d < 8; d++){
-      to = {p.x - d, p.y};
-      if(is(to) && any(to)){if((*this)[to].color != color) moves.push_back(to);break;}}
-      
-    return moves;
+  int materialEvaluation(){
+    int score = 0;
+    for(auto& piece: pieces)
+      if(piece.name != King)
+	score += (piece.color == turn) ? pieceValue(piece.name) : -pieceValue(piece.name);
+    return score;
   }
 
-  std::vector<SDL_Point> getBishopCaptureMoves(SDL_Point p, PieceColor color){
-    std::vector<SDL_Point> moves = {};
-    SDL_Point to;
-    for(int d = 1; d < 8; d++){
-      to = {p.x + d, p.y + d};
-      if(is(to) && any(to)){if((*this)[to].color != color) moves.push_back(to);break;}}
-    for(int d = 1; d < 8; d++){
-      to = {p.x + d, p.y - d};
-      if(is(to) && any(to)){if((*this)[to].color != color) moves.push_back(to);break;}}
-    for(int d = 1; d < 8; d++){
-      to = {p.x - d, p.y + d};
-      if(is(to) && any(to)){if((*this)[to].color != color) moves.push_back(to);break;}}
-    for(int d = 1; d < 8; d++){
-      to = {p.x - d, p.y - d};
-      if(is(to) && any(to)){if((*this)[to].color != color) moves.push_back(to);break;}}
-      
-    return moves;
+  // Centipawns from the side to move's point of view
+  int evaluate(){
+    if(!network) return materialEvaluation();
+    return NNUE::evaluate(*network, accumulator, turn);
   }
   
-  std::vector<SDL_Point> getQueenCaptureMoves(SDL_Point& position, PieceColor color){
-    std::vector<SDL_Point> moves = getRookCaptureMoves(position, color);
-    std::vector<SDL_Point> diagonalMoves = getBishopCaptureMoves(position, color);
-    moves.insert(moves.end(), diagonalMoves.begin(), diagonalMoves.end());
-    return moves;
+  Piece* at(SDL_Point position){
+    for(auto& piece: pieces) if(piece.position == position) return &piece;
+    return nullptr;
   }
 
-  
-  std::vector<SDL_Point> getKnightCaptureMoves(SDL_Point& p, PieceColor color){
-    std::vector<SDL_Point> moves = {};
-    std::vector<SDL_Point> knightDeltas = {
-      {2, 1}, {2, -1}, {-2, 1}, {-2, -1},
-      {1, 2}, {-1, 2}, {1, -2}, {-1, -2}};
-    SDL_Point to;
-    for(auto d: knightDeltas){
-      to = p + d; if(is(to) && any(to) && ((*this)[to].color != color)) moves.push_back(to);}
-    return moves;
+  /* ---------------- Move generation ---------------- */
+  // One generator per (piece, color) pair. The tables come from constexpr
+  // attack tables, so none of them checks bounds or branches on color.
+
+  template <PieceName name, PieceColor color>
+  void addMoves(SDL_Point p, std::vector<SDL_Point>& moves){
+    int s = square(p);
+    if constexpr(name == Pawn){
+      constexpr int forward = (color == White) ? 1 : -1;
+      constexpr int startRank = (color == White) ? 1 : 6;
+      constexpr int lastRank = (color == White) ? 7 : 0;
+      if(p.y == lastRank) return;
+      SDL_Point one = {p.x, p.y + forward};
+      if(any(one)) return;
+      moves.push_back(one);
+      SDL_Point two = {p.x, p.y + 2*forward};
+      if(p.y == startRank && !any(two)) moves.push_back(two);
+    }
+    else if constexpr(name == Knight || name == King){
+      const Targets& targets = (name == Knight) ? knightTargets : kingTargets;
+      for(int i = 0; i < targets.count[s]; i++)
+	if(!any(targets.to[s][i])) moves.push_back(targets.to[s][i]);
+    }
+    else{
+      constexpr int first = (name == Bishop) ? 4 : 0;
+      constexpr int last = (name == Rook) ? 4 : 8;
+      for(int d = first; d < last; d++){
+	SDL_Point to = p;
+	for(int i = 0; i < rays.length[s][d]; i++){
+	  to = to + directions[d];
+	  if(any(to)) break;
+	  moves.push_back(to);
+	}
+      }
+    }
   }
 
-  
-  std::vector<SDL_Point> getAllKingCaptureMoves(SDL_Point& p, PieceColor color){
-    std::vector<SDL_Point> moves = {};
+  template <PieceName name, PieceColor color>
+  void addCaptureMoves(SDL_Point p, std::vector<SDL_Point>& moves){
+    int s = square(p);
+    if constexpr(name == Pawn || name == Knight || name == King){
+      const Targets& targets = (name == Pawn) ? pawnCaptureTargets[color] :
+	((name == Knight) ? knightTargets : kingTargets);
+      for(int i = 0; i < targets.count[s]; i++){
+	Piece* victim = at(targets.to[s][i]);
+	if(victim && victim->color != color) moves.push_back(targets.to[s][i]);
+      }
+    }
+    else{
+      constexpr int first = (name == Bishop) ? 4 : 0;
+      constexpr int last = (name == Rook) ? 4 : 8;
+      for(int d = first; d < last; d++){
+	SDL_Point to = p;
+	for(int i = 0; i < rays.length[s][d]; i++){
+	  to = to + directions[d];
+	  Piece* victim = at(to);
+	  if(!victim) continue;
+	  if(victim->color != color) moves.push_back(to);
+	  break;
+	}
+      }
+    }
+  }
 
-    SDL_Point kingDeltas[8] = {
-      {-1, -1}, {1, 1}, {1, -1}, {-1, 1}, {0, 1}, {1, 0}, {0, -1}, {-1, 0}};
+  template <PieceName name, PieceColor color, bool captures>
+  void addTargets(SDL_Point p, std::vector<SDL_Point>& moves){
+    if constexpr(captures) addCaptureMoves<name, color>(p, moves);
+    else addMoves<name, color>(p, moves);
+  }
 
-    SDL_Point to;
-    for(auto d: kingDeltas){
-      to = p + d; if(is(to) && any(to) && ((*this)[to].color != color)) moves.push_back(to);}
+  typedef void (Board::*Generator)(SDL_Point, std::vector<SDL_Point>&);
+
+  // The generator for each (name, color) pair, in PieceName and PieceColor order
+  template <bool captures>
+  void addPieceTargets(Piece& piece, std::vector<SDL_Point>& moves){
+    static constexpr Generator generators[6][2] = {
+      {&Board::addTargets<Rook, Black, captures>, &Board::addTargets<Rook, White, captures>},
+      {&Board::addTargets<Knight, Black, captures>, &Board::addTargets<Knight, White, captures>},
+      {&Board::addTargets<Bishop, Black, captures>, &Board::addTargets<Bishop, White, captures>},
+      {&Board::addTargets<King, Black, captures>, &Board::addTargets<King, White, captures>},
+      {&Board::addTargets<Queen, Black, captures>, &Board::addTargets<Queen, White, captures>},
+      {&Board::addTargets<Pawn, Black, captures>, &Board::addTargets<Pawn, White, captures>},
+    };
+    (this->*generators[piece.name][piece.color])(piece.position, moves);
+  }
 
-    return moves;
+  // Pseudo-legal moves of every piece of the side to move. The color is
+  // resolved once here instead of in every generator call.
+  template <PieceColor color, bool captures>
+  void generate(std::vector<Move>& out){
+    std::vector<SDL_Point> targets;
+    for(auto& piece: pieces){
+      if(piece.color != color) continue;
+      targets.clear();
+      addPieceTargets<captures>(piece, targets);
+      for(auto& to: targets) out.push_back({piece, to});
+    }
   }
 
+  template <bool captures>
+  void generate(std::vector<Move>& out){
+    if(turn == White) generate<White, captures>(out);
+    else generate<Black, captures>(out);
+  }
+
+  // Generated into a reused buffer, so the result is allocated once at its
+  // final size, or not at all when there is no move
   std::vector<SDL_Point> getAllMoves(Piece piece){
-    switch(piece.name){
-    case Pawn: return getPawnMoves(piece.position, piece.color);
-    case Rook: return getRookMoves(piece.position);
-    case Knight: return getKnightMoves(piece.position);
-    case Bishop: return getBishopMoves(piece.position);
-    case Queen: return getQueenMoves(piece.position);
-    case King: return getAllKingMoves(piece.position);
-    }
-    return {};  
+    static thread_local std::vector<SDL_Point> scratch;
+    scratch.clear();
+    addPieceTargets<false>(piece, scratch);
+    return std::vector<SDL_Point>(scratch.begin(), scratch.end());
   }
 
-  
   std::vector<SDL_Point> getAllCaptureMoves(Piece piece){
-    switch(piece.name){
-    case Pawn: return getPawnCaptureMoves(piece.position, piece.color);
-    case Rook: return getRookCaptureMoves(piece.position, piece.color);
-    case Knight: return getKnightCaptureMoves(piece.position, piece.color);
-    case Bishop: return getBishopCaptureMoves(piece.position, piece.color);
-    case Queen: return getQueenCaptureMoves(piece.position, piece.color);
-    case King: return getAllKingCaptureMoves(piece.position, piece.color);
-    }
-    return {};  
+    static thread_local std::vector<SDL_Point> scratch;
+    scratch.clear();
+    addPieceTargets<true>(piece, scratch);
+    return std::vector<SDL_Point>(scratch.begin(), scratch.end());
+  }
+
+  // Squares a pawn attacks whether or not something stands there
+  std::vector<SDL_Point> getPawnPossibleCaptureMoves(SDL_Point& p, PieceColor color){
+    const Targets& targets = pawnCaptureTargets[color];
+    int s = square(p);
+    return std::vector<SDL_Point>(targets.to[s], targets.to[s] + targets.count[s]);
   }
 
   
+  // Whether a piece of `color` attacks `position`, own pieces standing there included
   bool isCovered(SDL_Point position, PieceColor color){
-    for(auto piece: pieces){
+    ALLOC_SCOPE(Alloc::IsCovered);
+    uint64_t occupied = occupancy();
+    for(auto& piece: pieces){
       if(piece.color != color) continue;
       if(piece.position == position) continue;
-
-    
-      std::vector<SDL_Point> moves = getAllMoves(piece);
-      if(piece.name == Pawn) moves = getPawnPossibleCaptureMoves(piece.position, piece.color);
-    
-      for(auto& move: moves) if(move == position) return true;
-
-      if(piece.name == Pawn) continue;
-
-      moves = getAllCaptureMoves(piece);
-      for(auto& move: moves)
-	if(move == position) return true;
-    
-      piece.color = !color;
-
-      moves = getAllCaptureMoves(piece);
-      for(auto& move: moves)
-	if(move == position) return true;
+      if(attacks(piece, position, occupied)) return true;
     }
-
     return false;
   }
     
@@ -384,7 +577,7 @@ struct Board{
   }
 
   std::vector<SDL_Point> getMoves(Piece piece){
-    
+    ALLOC_SCOPE(Alloc::GetMoves);
     std::vector<SDL_Point> allMoves = getAllMoves(piece);
     std::vector<SDL_Point> moves = {};
 
@@ -392,14 +585,12 @@ struct Board{
     if(!isKingInCheck(piece.color) && piece.name != King)
       return allMoves;
       
+    // one copy for all trial moves, restoring it reuses the capacity
+    std::vector<Piece> savedPieces = pieces;
     for(auto move: allMoves){
-	
-      // Why the fuck making one move and then moving back doesnt fucking word????
-      std::vector<Piece> savedPieces = pieces;
-      makeMove(piece, move);
+      movePiece(piece, move);
       if(!isKingInCheck(piece.color)) moves.push_back(move);
       pieces = savedPieces;
-	
     }
 
     return moves;
@@ -416,14 +607,12 @@ struct Board{
     if(!isKingInCheck(piece.color) && piece.name != King)
       return allMoves;
       
+    // one copy for all trial moves, restoring it reuses the capacity
+    std::vector<Piece> savedPieces = pieces;
     for(auto move: allMoves){
-	
-      // Why the fuck making one move and then moving back doesnt fucking word????
-      std::vector<Piece> savedPieces = pieces;
-      makeMove(piece, move);
+      movePiece(piece, move);
       if(!isKingInCheck(piece.color)) moves.push_back(move);
       pieces = savedPieces;
-	
     }
 
     return moves;
@@ -431,7 +620,23 @@ struct Board{
   }
 
 
+  // Fully legal moves for the side to move, pins included
+  std::vector<Move> legalMoves(){
+    std::vector<Move> candidates, legal;
+    generate<false>(candidates);
+    generate<true>(candidates);
+
+    std::vector<Piece> savedPieces = pieces;
+    for(auto& move: candidates){
+      movePiece(move.piece, move.to);
+      if(!isKingInCheck(move.piece.color)) legal.push_back(move);
+      pieces = savedPieces;
+    }
+    return legal;
+  }
+
   void updateMoves(){
+    ALLOC_SCOPE(Alloc::UpdateMoves);
     captureMoves.clear();
     moves.clear();
 
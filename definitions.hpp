@@ -13,8 +13,14 @@ const SDL_Color BLACK_TILE_COLOR = {118, 150, 86, 255};
 const SDL_Color WHITE_TILE_COLOR = {238, 238, 210, 255};
 const SDL_Color SELECTED_TILE_BLACK_COLOR = {187, 203, 43, 255};
 const SDL_Color SELECTED_TILE_WHITE_COLOR =  {247, 247, 105, 255};
+const SDL_Color WINNING_CAPTURE_COLOR = {40, 160, 60, 110};
+const SDL_Color LOSING_CAPTURE_COLOR = {200, 40, 40, 110};
 
 #define SWITCH_SIDE_MODE false
+#define SEE_HIGHLIGHT_MODE false
+#define COMPUTER_PLAYER false
+#define CLOCK_BASE_MS (5*60*1000)
+#define CLOCK_INCREMENT_MS (3*1000)
 
 bool operator==(SDL_Point const& a, SDL_Point const& b){
   return (a.x == b.x) && (a.y == b.y);}
@@ -28,25 +34,17 @@ SDL_Point operator-(SDL_Point const& a, SDL_Point const& b){
 void SetRenderDrawColor(SDL_Renderer* renderer, SDL_Color color) {
   SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);}
 
+// Draw calls issued so far, read by the rendering benchmark
+uint64_t drawCalls = 0;
 
-SDL_Texture* loadTexture(SDL_Renderer* renderer, std::string path){
-  SDL_Surface* surface = IMG_Load(path.c_str());
-  SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
-  SDL_FreeSurface(surface);
-  return texture;
-};
+int RenderCopy(SDL_Renderer* renderer, SDL_Texture* texture, const SDL_Rect* src, const SDL_Rect* dst){
+  drawCalls++;
+  return SDL_RenderCopy(renderer, texture, src, dst);}
 
+int RenderFillRect(SDL_Renderer* renderer, const SDL_Rect* rect){
+  drawCalls++;
+  return SDL_RenderFillRect(renderer, rect);}
 
-void renderTextSolid(SDL_Renderer* renderer, TTF_Font* font, const char* text, SDL_Color c, SDL_Rect* r){
-  SDL_Surface* textSurface = TTF_RenderText_Solid(font, text, c);
-  SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-  SDL_FreeSurface(textSurface);
-
-  SDL_RenderCopy(renderer, textTexture, NULL, r);
-  SDL_DestroyTexture(textTexture);
-}
-
-TTF_Font* font;
 
 enum GameMode{Free, Game};
 
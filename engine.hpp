@@ -0,0 +1,456 @@
+#ifndef ENGINE_HPP
+#define ENGINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "chess.hpp"
+
+namespace Engine{
+
+using Chess::Move;
+
+const int Infinity = 1000000;
+const int MateScore = 100000;
+const int MaxPly = 64;
+
+struct Stats{
+  uint64_t nodes = 0;
+  uint64_t cutoffs = 0;
+  uint64_t firstMoveCutoffs = 0;
+
+  double firstMoveCutoffRate(){
+    return cutoffs ? (double)firstMoveCutoffs / (double)cutoffs : 0.0;}
+};
+
+/* ---------------- Ordering heuristics ---------------- */
+
+struct Heuristics{
+  Move killers[MaxPly][2];
+  bool hasKiller[MaxPly][2];
+  int history[2][64][64];
+
+  Heuristics(){clear();}
+
+  void clear(){
+    for(int ply = 0; ply < MaxPly; ply++) hasKiller[ply][0] = hasKiller[ply][1] = false;
+    for(auto& side: history) for(auto& from: side) for(auto& to: from) to = 0;
+  }
+
+  void updateKiller(int ply, Move move){
+    if(ply >= MaxPly) return;
+    if(hasKiller[ply][0] && killers[ply][0] == move) return;
+    killers[ply][1] = killers[ply][0]; hasKiller[ply][1] = hasKiller[ply][0];
+    killers[ply][0] = move; hasKiller[ply][0] = true;
+  }
+
+  int& historyOf(Move move){
+    return history[move.piece.color][Chess::square(move.piece.position)][Chess::square(move.to)];}
+
+  void updateHistory(Move move, int depth){
+    int& value = historyOf(move);
+    value += depth * depth;
+    // keep scores bounded so old searches fade out
+    if(value > (1 << 20))
+      for(auto& side: history) for(auto& from: side) for(auto& to: from) to /= 2;
+  }
+};
+
+/* ---------------- Transposition table ---------------- */
+
+enum Bound{Exact, Lower, Upper};
+
+struct TTEntry{
+  uint64_t key = 0;
+  Move move;
+  bool hasMove = false;
+  int depth = -1;
+  int score = 0;
+  Bound bound = Exact;
+  uint16_t generation = 0;
+};
+
+// Mate scores are relative to the root (MateScore - plies to mate). The
+// table keeps them relative to the entry's node, so a mate found through
+// one path is still the right distance when the position is reached
+// through another.
+int scoreToTable(int score, int ply){
+  if(score > MateScore - MaxPly) return score + ply;
+  if(score < -MateScore + MaxPly) return score - ply;
+  return score;
+}
+
+int scoreFromTable(int score, int ply){
+  if(score > MateScore - MaxPly) return score - ply;
+  if(score < -MateScore + MaxPly) return score + ply;
+  return score;
+}
+
+struct TranspositionTable{
+  std::vector<TTEntry> entries = std::vector<TTEntry>(1 << 16);
+  uint16_t generation = 0; // entries from older generations are misses
+
+  TTEntry* probe(uint64_t key){
+    TTEntry& entry = entries[key & (entries.size() - 1)];
+    return (entry.key == key && entry.generation == generation) ? &entry : nullptr;
+  }
+
+  void store(uint64_t key, int depth, int score, Bound bound, Move move, bool hasMove){
+    TTEntry& entry = entries[key & (entries.size() - 1)];
+    bool same = entry.key == key && entry.generation == generation;
+    if(same && entry.depth > depth) return;
+    if(!hasMove && same){move = entry.move; hasMove = entry.hasMove;}
+    entry = {key, move, hasMove, depth, score, bound, generation};
+  }
+
+  void clear(){for(auto& entry: entries) entry = {}; generation = 0;}
+
+  // Forgets every entry without touching the table
+  void newSearch(){if(++generation == 0) clear();}
+};
+
+/* ---------------- Staged move picker ---------------- */
+
+enum Stage{
+  HashMove, GenerateCaptures, GoodCaptures, Killers,
+  GenerateQuiets, Quiets, BadCaptures, Done};
+
+typedef struct{
+  Move move;
+  int score;
+} ScoredMove;
+
+// Ordinal used by MVV-LVA, indexed by PieceName
+const int victimRank[] = {4, 2, 3, 6, 5, 1};
+
+int mvvLva(Move move, Chess::PieceName victim){
+  return victimRank[victim] * 8 - victimRank[move.piece.name];}
+
+// Hands out pseudo-legal moves one at a time: hash move, captures by MVV-LVA,
+// killers, quiets by history, then the captures SEE says lose material.
+// Each stage only generates its moves when reached, so a cutoff skips the
+// rest. With capturesOnly losing captures are pruned.
+struct MovePicker{
+  Chess::Board& board;
+  Heuristics& heuristics;
+  int ply;
+  bool capturesOnly;
+
+  Move hashMove;
+  bool hasHashMove;
+
+  Stage stage = HashMove;
+  std::vector<ScoredMove> captures, quiets;
+  std::vector<Move> badCaptures;
+  size_t index = 0;
+  int killerIndex = 0;
+
+  MovePicker(Chess::Board& board, Heuristics& heuristics, int ply,
+	     TTEntry* entry, bool capturesOnly = false)
+    : board(board), heuristics(heuristics), ply(ply), capturesOnly(capturesOnly){
+    hasHashMove = entry && entry->hasMove && isPseudoLegal(entry->move) &&
+      (!capturesOnly || board.any(entry->move.to));
+    if(hasHashMove) hashMove = entry->move;
+  }
+
+  bool isPseudoLegal(Move move){
+    if(!board.any(move.piece.position)) return false;
+    Chess::Piece piece = board[move.piece.position];
+    if(piece.name != move.piece.name || piece.color != move.piece.color) return false;
+    if(piece.color != board.turn) return false;
+
+    std::vector<SDL_Point> targets = board.any(move.to) ?
+      board.getAllCaptureMoves(piece) : board.getAllMoves(piece);
+    for(auto& to: targets) if(to == move.to) return true;
+    return false;
+  }
+
+  bool isHashMove(Move& move){return hasHashMove && move == hashMove;}
+
+  bool isKiller(Move& move){
+    if(ply >= MaxPly) return false;
+    for(int i = 0; i < 2; i++)
+      if(heuristics.hasKiller[ply][i] && heuristics.killers[ply][i] == move) return true;
+    return false;
+  }
+
+  // Captures that don't lose material are tried before the quiet moves
+  bool isGoodCapture(ScoredMove& scored){
+    if(board.pieceValue(board[scored.move.to].name) >= board.pieceValue(scored.move.piece.name))
+      return true;
+    return board.see(scored.move) >= 0;
+  }
+
+  void generateCaptures(){
+    std::vector<Move> moves;
+    board.generate<true>(moves);
+    for(auto& move: moves)
+      if(!isHashMove(move)) captures.push_back({move, mvvLva(move, board.at(move.to)->name)});
+  }
+
+  void generateQuiets(){
+    std::vector<Move> moves;
+    board.generate<false>(moves);
+    for(auto& move: moves)
+      if(!isHashMove(move) && !isKiller(move)) quiets.push_back({move, heuristics.historyOf(move)});
+  }
+
+  // Selection sort step: cheaper than a full sort when a cutoff comes early
+  ScoredMove& pickBest(std::vector<ScoredMove>& moves){
+    size_t best = index;
+    for(size_t i = index + 1; i < moves.size(); i++)
+      if(moves[i].score > moves[best].score) best = i;
+    std::swap(moves[index], moves[best]);
+    return moves[index++];
+  }
+
+  bool next(Move& move){
+    switch(stage){
+    case HashMove:
+      stage = GenerateCaptures;
+      if(hasHashMove){move = hashMove; return true;}
+      [[fallthrough]];
+
+    case GenerateCaptures:
+      generateCaptures();
+      index = 0;
+      stage = GoodCaptures;
+      [[fallthrough]];
+
+    case GoodCaptures:
+      while(index < captures.size()){
+	ScoredMove& scored = pickBest(captures);
+	if(!isGoodCapture(scored)){
+	  if(!capturesOnly) badCaptures.push_back(scored.move);
+	  continue;
+	}
+	move = scored.move; return true;
+      }
+      stage = capturesOnly ? Done : Killers;
+      if(capturesOnly) return false;
+      [[fallthrough]];
+
+    case Killers:
+      while(ply < MaxPly && killerIndex < 2){
+	int i = killerIndex++;
+	if(!heuristics.hasKiller[ply][i]) continue;
+	Move killer = heuristics.killers[ply][i];
+	if(isHashMove(killer) || board.any(killer.to) || !isPseudoLegal(killer)) continue;
+	move = killer; return true;
+      }
+      stage = GenerateQuiets;
+      [[fallthrough]];
+
+    case GenerateQuiets:
+      generateQuiets();
+      index = 0;
+      stage = Quiets;
+      [[fallthrough]];
+
+    case Quiets:
+      if(index < quiets.size()){move = pickBest(quiets).move; return true;}
+      index = 0;
+      stage = BadCaptures;
+      [[fallthrough]];
+
+    case BadCaptures:
+      if(index < badCaptures.size()){move = badCaptures[index++]; return true;}
+      stage = Done;
+      [[fallthrough]];
+
+    case Done:
+      return false;
+    }
+    return false;
+  }
+};
+
+/* ---------------- Search ---------------- */
+
+// Alpha-beta over a private copy of the board. Positions are restored by
+// saving `pieces` like Board::getMoves does.
+struct Search{
+  Chess::Board board;
+  Heuristics heuristics;
+  TranspositionTable tt;
+  Stats stats;
+
+  Move bestMove;
+  bool hasBestMove = false;
+  int bestScore = 0;
+  int completedDepth = 0;
+
+  // Set by another thread to abandon the search, the last completed
+  // iteration's result is kept
+  std::atomic<bool>* stop = nullptr;
+  std::function<void(Search&)> onIteration;
+
+  // Optional budgets, 0 means unlimited
+  uint64_t maxNodes = 0;
+  int64_t maxMilliseconds = 0;
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  bool limitReached = false;
+
+  Search(Chess::Board& position) : board(position){}
+
+  // Readies the search for an unrelated position, reusing its tables
+  void reset(Chess::Board& position){
+    board = position;
+    heuristics.clear();
+    tt.newSearch();
+    stats = {};
+    hasBestMove = false;
+    bestScore = 0;
+    completedDepth = 0;
+    limitReached = false;
+  }
+
+  bool stopped(){
+    if(stop && stop->load(std::memory_order_relaxed)) return true;
+    if(limitReached) return true;
+    // budgets only apply once there is a move to play
+    if(completedDepth == 0) return false;
+    if(maxNodes && stats.nodes >= maxNodes) limitReached = true;
+    // reading the clock on every node is not free
+    if(maxMilliseconds && (stats.nodes & 255) == 0 &&
+       std::chrono::steady_clock::now() - startTime > std::chrono::milliseconds(maxMilliseconds))
+      limitReached = true;
+    return limitReached;
+  }
+
+  void makeMove(Move move){
+    board.makeMove(move.piece, move.to);
+    board.switchTurn();
+  }
+
+  int quiescence(int alpha, int beta, int ply){
+    if(stopped()) return 0;
+    stats.nodes++;
+
+    int standPat = board.evaluate();
+    if(standPat >= beta || ply >= MaxPly) return standPat;
+    if(standPat > alpha) alpha = standPat;
+
+    MovePicker picker(board, heuristics, ply, nullptr, true);
+    Move move;
+    while(picker.next(move)){
+      std::vector<Chess::Piece> savedPieces = board.pieces;
+      NNUE::Accumulator savedAccumulator = board.accumulator;
+      makeMove(move);
+
+      int score = -Infinity;
+      if(!board.isKingInCheck(!board.turn)) score = -quiescence(-beta, -alpha, ply + 1);
+
+      board.pieces = savedPieces;
+      board.accumulator = savedAccumulator;
+      board.switchTurn();
+
+      if(stopped()) return 0;
+      if(score >= beta) return score;
+      if(score > alpha) alpha = score;
+    }
+    return alpha;
+  }
+
+  int negamax(int depth, int alpha, int beta, int ply){
+    if(depth <= 0) return quiescence(alpha, beta, ply);
+    if(stopped()) return 0;
+    stats.nodes++;
+
+    uint64_t key = board.hash();
+    TTEntry* entry = tt.probe(key);
+    if(entry && ply > 0 && entry->depth >= depth){
+      int score = scoreFromTable(entry->score, ply);
+      if(entry->bound == Exact) return score;
+      if(entry->bound == Lower && score >= beta) return score;
+      if(entry->bound == Upper && score <= alpha) return score;
+    }
+
+    int originalAlpha = alpha;
+    int best = -Infinity;
+    Move bestHere;
+    int legalMoves = 0;
+
+    MovePicker picker(board, heuristics, ply, entry);
+    Move move;
+    while(picker.next(move)){
+      bool isCapture = board.any(move.to);
+      std::vector<Chess::Piece> savedPieces = board.pieces;
+      NNUE::Accumulator savedAccumulator = board.accumulator;
+      makeMove(move);
+
+      bool legal = !board.isKingInCheck(!board.turn);
+      int score = 0;
+      if(legal) score = -negamax(depth - 1, -beta, -alpha, ply + 1);
+
+      board.pieces = savedPieces;
+      board.accumulator = savedAccumulator;
+      board.switchTurn();
+
+      if(stopped()) return 0;
+      if(!legal) continue;
+      legalMoves++;
+
+      if(score > best){best = score; bestHere = move;}
+      if(score > alpha) alpha = score;
+      if(alpha >= beta){
+	stats.cutoffs++;
+	if(legalMoves == 1) stats.firstMoveCutoffs++;
+	if(!isCapture){
+	  heuristics.updateKiller(ply, move);
+	  heuristics.updateHistory(move, depth);
+	}
+	break;
+      }
+    }
+
+    if(legalMoves == 0)
+      return board.isKingInCheck(board.turn) ? -MateScore + ply : 0;
+
+    Bound bound = (best >= beta) ? Lower : ((best > originalAlpha) ? Exact : Upper);
+    tt.store(key, depth, scoreToTable(best, ply), bound, bestHere, true);
+
+    if(ply == 0){bestMove = bestHere; hasBestMove = true; bestScore = best;}
+    return best;
+  }
+
+  bool isMateScore(int score){return std::abs(score) > MateScore - MaxPly;}
+
+  // Iterative deepening, each iteration seeds the next through the hash move
+  int run(int maxDepth){
+    startTime = std::chrono::steady_clock::now();
+    for(int depth = 1; depth <= maxDepth; depth++){
+      negamax(depth, -Infinity, Infinity, 0);
+      if(stopped()) break;
+      completedDepth = depth;
+      if(onIteration) onIteration(*this);
+      if(hasBestMove && isMateScore(bestScore)) break;
+    }
+    return bestScore;
+  }
+
+  // Follows hash moves from the root on a scratch copy of the board
+  std::vector<Move> principalVariation(int maxLength = 16){
+    std::vector<Move> line;
+    Chess::Board position = board;
+    position.network = nullptr;
+
+    for(int i = 0; i < maxLength; i++){
+      TTEntry* entry = tt.probe(position.hash());
+      if(!entry || !entry->hasMove) break;
+      Move move = entry->move;
+      if(!position.any(move.piece.position) || position.turn != move.piece.color) break;
+      line.push_back(move);
+      position.makeMove(move.piece, move.to);
+      position.switchTurn();
+    }
+    return line;
+  }
+};
+
+}
+
+#endif
@@ -8,6 +8,9 @@
 
 #include "definitions.hpp"
 #include "chess.hpp"
+#include "analysis.hpp"
+#include "player.hpp"
+#include "atlas.hpp"
 
 struct Window{
   SDL_Window* sdlWindow;
@@ -61,6 +64,17 @@ struct Board{
 	size, size};
   }
 
+  // Inverse of getTileScreenRect, {-1, -1} outside the tiles
+  SDL_Point getTileAt(SDL_Point point){
+    int size = this->position.w / 8;
+    if(size == 0) return {-1, -1};
+    int column = point.x - this->position.x, row = point.y - this->position.y;
+    if(column < 0 || row < 0 || column >= 8*size || row >= 8*size) return {-1, -1};
+    column /= size;
+    row /= size;
+    return {column, (side == Chess::White) ? 7 - row : row};
+  }
+
   void reset(){ side = Chess::White; };
   
   void switchSide(){
@@ -88,14 +102,128 @@ struct Button{
 
   void render(SDL_Renderer* renderer){
     SetRenderDrawColor(renderer, (SDL_Color){200, 200, 200, 200});    
-    SDL_RenderFillRect(renderer, &position);
-    renderTextSolid(renderer, font, text, {0, 0, 0, 255}, &textPosition);
+    RenderFillRect(renderer, &position);
+    atlas.renderText(renderer, text, {0, 0, 0, 255}, &textPosition);
   }
 
   std::function<void(Button&, Window*, Board*)> __updateOnResize;
   
   void updateOnResize(Window* window, Board* board){__updateOnResize(*this, window, board);};
 };
+
+// Renders one line of text `height` pixels tall at `position`, keeping the font's aspect
+void renderTextLine(SDL_Renderer* renderer, const char* text, SDL_Point position, int height){
+  int textWidth, textHeight;
+  atlas.sizeText(text, &textWidth, &textHeight);
+  if(textWidth == 0 || textHeight == 0) return;
+  SDL_Rect rect = {position.x, position.y, (int)(height * ((float)textWidth / (float)textHeight)), height};
+  atlas.renderText(renderer, text, {0, 0, 0, 255}, &rect);
+}
+
+std::string formatScore(int score){
+  if(std::abs(score) > Engine::MateScore - Engine::MaxPly){
+    int plies = Engine::MateScore - std::abs(score);
+    return std::string(score > 0 ? "#" : "#-") + std::to_string((plies + 1) / 2);
+  }
+  char text[16];
+  snprintf(text, sizeof(text), "%+.2f", score / 100.0);
+  return text;
+}
+
+std::string formatClock(int64_t ms){
+  if(ms < 0) ms = 0;
+  char text[16];
+  if(ms < 10000) snprintf(text, sizeof(text), "%d:%02d.%d", (int)(ms / 60000), (int)(ms / 1000 % 60), (int)(ms / 100 % 10));
+  else snprintf(text, sizeof(text), "%d:%02d", (int)(ms / 60000), (int)(ms / 1000 % 60));
+  return text;
+}
+
+// Both clocks to the right of the buttons: the side at the top of the board
+// next to the first button, the side at the bottom next to the second one
+struct ClockDisplay{
+  SDL_Rect top;
+  SDL_Rect bottom;
+
+  void updateOnResize(Button& topButton, Button& bottomButton){
+    int gap = (int)(0.3 * topButton.position.h);
+    top = topButton.position;
+    top.x += top.w + gap;
+    top.w = (int)(0.6 * top.w);
+    bottom = bottomButton.position;
+    bottom.x += bottom.w + gap;
+    bottom.w = top.w;
+  }
+
+  void renderClock(SDL_Renderer* renderer, SDL_Rect& rect, int64_t ms, bool active){
+    SetRenderDrawColor(renderer, active ? (SDL_Color){247, 247, 105, 255} : (SDL_Color){200, 200, 200, 200});
+    RenderFillRect(renderer, &rect);
+    int height = (int)(0.6 * rect.h);
+    renderTextLine(renderer, formatClock(ms).c_str(),
+		   {rect.x + (int)(0.1 * rect.w), rect.y + (rect.h - height)/2}, height);
+  }
+
+  void render(SDL_Renderer* renderer, Player::Clock& clock, Board* board){
+    Chess::PieceColor bottomSide = board->side, topSide = !board->side;
+    renderClock(renderer, top, clock.timeLeft(topSide), clock.running && clock.side == topSide);
+    renderClock(renderer, bottom, clock.timeLeft(bottomSide), clock.running && clock.side == bottomSide);
+  }
+};
+
+// Eval bar between the board and the buttons, search info and PV below the buttons
+struct AnalysisPanel{
+  SDL_Rect evalBar;
+  SDL_Rect text;
+
+  void updateOnResize(Window* window, Board* board){
+    int gap = (int)(0.01 * board->position.h);
+    evalBar = {
+      board->position.x + board->position.w + gap,
+      board->position.y,
+      (int)(0.025 * board->position.h),
+      board->position.h};
+
+    int left = board->position.x + board->position.w + (int)(0.05 * board->position.h);
+    text = {
+      left,
+      board->position.y + (int)(0.3 * board->position.h),
+      window->position.w - left,
+      (int)(0.4 * board->position.h)};
+  }
+
+  void render(SDL_Renderer* renderer, Analysis::Info& info, bool any){
+    int whiteScore = any ? info.whiteScore() : 0;
+    float share = 0.5f + std::max(-1000, std::min(1000, whiteScore)) / 2000.0f;
+    if(any && std::abs(whiteScore) > Engine::MateScore - Engine::MaxPly) share = (whiteScore > 0) ? 1.0f : 0.0f;
+
+    SetRenderDrawColor(renderer, (SDL_Color){40, 40, 40, 255});
+    RenderFillRect(renderer, &evalBar);
+    SDL_Rect white = evalBar;
+    white.h = (int)(evalBar.h * share);
+    white.y = evalBar.y + evalBar.h - white.h;
+    SetRenderDrawColor(renderer, (SDL_Color){235, 235, 235, 255});
+    RenderFillRect(renderer, &white);
+
+    if(!any) return;
+
+    int lineHeight = text.h / 10;
+    char line[96];
+    snprintf(line, sizeof(line), "%s  depth %d  %llu knps  cut1 %d%%", formatScore(whiteScore).c_str(),
+	     info.depth, (unsigned long long)(info.nps / 1000), (int)(100 * info.firstMoveCutoffRate));
+    renderTextLine(renderer, line, {text.x, text.y}, lineHeight);
+
+    // PV, a few moves per line
+    std::string pv;
+    int row = 1;
+    for(size_t i = 0; i < info.pv.size() && row < 10; i++){
+      pv += Chess::moveName(info.pv[i]) + " ";
+      if(i % 6 == 5 || i + 1 == info.pv.size()){
+	renderTextLine(renderer, pv.c_str(), {text.x, text.y + row * lineHeight}, lineHeight);
+	pv.clear();
+	row++;
+      }
+    }
+  }
+};
   
 }
 
@@ -118,7 +246,7 @@ void updateResetButtonOnResize(GUI::Button& button, Window* window, GUI::Board*
   };
 
   int textWidth, textHeight;
-  TTF_SizeText(font, button.text, &textWidth, &textHeight);
+  atlas.sizeText(button.text, &textWidth, &textHeight);
     
   float alpha = 0.25;
   int textWidthScaled = alpha * button.position.w;
@@ -151,7 +279,7 @@ void updateSwitchSideButtonOnResize(GUI::Button& button, Window* window, GUI::Bo
   };
 
   int textWidth, textHeight;
-  TTF_SizeText(font, button.text, &textWidth, &textHeight);
+  atlas.sizeText(button.text, &textWidth, &textHeight);
   
   float alpha = 0.5;
   int textWidthScaled = alpha * button.position.w;
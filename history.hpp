@@ -0,0 +1,137 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "chess.hpp"
+
+// Game history as a tree of compact move records. Every node is one ply
+// (24 bytes), the board is moved along the tree by replaying or reverting
+// single records, never by storing positions.
+namespace History{
+
+const uint8_t NoPiece = 0xFF;
+const uint32_t None = 0xFFFFFFFF;
+
+typedef struct{
+  uint8_t from;     // square, x + 8*y
+  uint8_t to;
+  uint8_t moved;    // name*2 + color
+  uint8_t captured; // same encoding, NoPiece for a quiet move
+  bool switchedTurn; // false for moves made in Free mode
+} Record;
+
+bool operator==(Record const& a, Record const& b){
+  return a.from == b.from && a.to == b.to && a.moved == b.moved &&
+    a.captured == b.captured && a.switchedTurn == b.switchedTurn;}
+
+uint8_t encode(Chess::Piece& piece){return piece.name*2 + piece.color;}
+
+SDL_Point point(uint8_t square){return {square % 8, square / 8};}
+
+Chess::Piece decode(uint8_t code, uint8_t square){
+  Chess::PieceName name = (Chess::PieceName)(code / 2);
+  Chess::PieceColor color = (Chess::PieceColor)(code % 2);
+  return {name, color, point(square), Chess::spritePositionOf(name, color)};
+}
+
+typedef struct{
+  Record record;
+  uint32_t parent;
+  uint32_t firstChild;
+  uint32_t nextSibling;
+  uint32_t lastChild; // the variation redo follows
+} Node;
+
+struct Tree{
+  std::vector<Node> nodes; // nodes[0] is the starting position
+  uint32_t current = 0;
+
+  Tree(){clear();}
+
+  void clear(){
+    nodes.clear();
+    nodes.push_back({{}, None, None, None, None});
+    current = 0;
+  }
+
+  bool atStart(){return current == 0;}
+
+  void apply(Chess::Board& board, Record& record){
+    board.makeMove(board[point(record.from)], point(record.to));
+    if(record.switchedTurn) board.switchTurn();
+  }
+
+  void revert(Chess::Board& board, Record& record){
+    bool captured = record.captured != NoPiece;
+    Chess::Piece victim = captured ? decode(record.captured, record.to) : Chess::Piece{};
+    board.unmakeMove(board[point(record.to)], point(record.from), captured, victim);
+    if(record.switchedTurn) board.switchTurn();
+  }
+
+  // Records the move and makes it. Playing a move that already exists from
+  // here just follows it, anything else starts a new variation.
+  void play(Chess::Board& board, Chess::Piece piece, SDL_Point to, bool switchTurn){
+    // records hold squares in a byte, anything off the board can't be undone
+    assert(piece.position.x >= 0 && piece.position.x < 8 && piece.position.y >= 0 && piece.position.y < 8);
+    assert(to.x >= 0 && to.x < 8 && to.y >= 0 && to.y < 8);
+    Record record = {
+      (uint8_t)Chess::square(piece.position), (uint8_t)Chess::square(to), encode(piece),
+      board.any(to) ? encode(*board.at(to)) : NoPiece, switchTurn};
+
+    uint32_t child = nodes[current].firstChild;
+    while(child != None && !(nodes[child].record == record)) child = nodes[child].nextSibling;
+
+    if(child == None){
+      child = nodes.size();
+      nodes.push_back({record, current, None, nodes[current].firstChild, None});
+      nodes[current].firstChild = child;
+    }
+    nodes[current].lastChild = child;
+    current = child;
+    apply(board, record);
+  }
+
+  bool undo(Chess::Board& board){
+    if(atStart()) return false;
+    revert(board, nodes[current].record);
+    current = nodes[current].parent;
+    return true;
+  }
+
+  bool redo(Chess::Board& board){
+    uint32_t child = nodes[current].lastChild;
+    if(child == None) return false;
+    current = child;
+    apply(board, nodes[current].record);
+    return true;
+  }
+
+  // Steps to the previous (-1) or next (+1) variation of the current move
+  bool switchVariation(Chess::Board& board, int direction){
+    if(atStart()) return false;
+    uint32_t parent = nodes[current].parent;
+
+    std::vector<uint32_t> siblings;
+    for(uint32_t child = nodes[parent].firstChild; child != None; child = nodes[child].nextSibling)
+      siblings.push_back(child);
+    if(siblings.size() < 2) return false;
+
+    size_t index = 0;
+    while(siblings[index] != current) index++;
+    uint32_t target = siblings[(index + siblings.size() + direction) % siblings.size()];
+
+    undo(board);
+    nodes[parent].lastChild = target;
+    return redo(board);
+  }
+
+  void toStart(Chess::Board& board){while(undo(board));}
+  void toEnd(Chess::Board& board){while(redo(board));}
+};
+
+}
+
+#endif
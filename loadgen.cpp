@@ -0,0 +1,218 @@
+// Load generator for server.cpp. Every connection keeps a number of games
+// in flight, each one pipelined: ask for the legal moves (or the engine's
+// move with --think), play one, repeat until the game ends, then start a
+// new one. Reports round-trip p50/p99 and finished games per second.
+//
+//   ./loadgen --connections 8 --games 32 --seconds 10
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "protocol.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+const int MAX_PLIES = 200;
+
+struct Settings{
+  std::string socketPath = Protocol::DefaultSocketPath;
+  int connections = 4;
+  int games = 16;           // in flight per connection
+  double seconds = 10;
+  uint32_t thinkNodes = 0;  // 0 plays random legal moves
+};
+
+typedef struct{
+  uint32_t game = 0;
+  int plies = 0;
+  Protocol::Type pending = Protocol::NewGame;
+  Clock::time_point sent;
+} GameState;
+
+typedef struct{
+  std::vector<uint32_t> latencies;
+  uint64_t requests = 0;
+  uint64_t games = 0;
+  uint64_t errors = 0;
+} Totals;
+
+bool readAll(int fd, void* data, size_t size){
+  uint8_t* bytes = (uint8_t*)data;
+  while(size > 0){
+    ssize_t received = read(fd, bytes, size);
+    if(received <= 0) return false;
+    bytes += received;
+    size -= received;
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void* data, size_t size){
+  const uint8_t* bytes = (const uint8_t*)data;
+  while(size > 0){
+    ssize_t written = write(fd, bytes, size);
+    if(written <= 0) return false;
+    bytes += written;
+    size -= written;
+  }
+  return true;
+}
+
+int connectTo(std::string path){
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  if(fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0){
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// One connection: request ids are indices into `games`, so out of order
+// replies from different server workers are matched back to their game
+void runConnection(Settings& settings, int seed, Totals& totals, std::mutex& mutex){
+  using namespace Protocol;
+  int fd = connectTo(settings.socketPath);
+  if(fd < 0){std::cerr << "Cannot connect to " << settings.socketPath << "\n"; return;}
+
+  std::mt19937 random(seed);
+  std::vector<GameState> games(settings.games);
+  Totals local;
+  Clock::time_point end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(settings.seconds));
+
+  auto send = [&](uint32_t index, Type type, uint8_t from = 0, uint8_t to = 0){
+    Request request = {index, games[index].game, settings.thinkNodes, type, from, to, 0};
+    games[index].pending = type;
+    games[index].sent = Clock::now();
+    return writeAll(fd, &request, sizeof(request));
+  };
+
+  for(int i = 0; i < settings.games; i++) send(i, NewGame);
+  int inFlight = settings.games;
+
+  std::vector<WireMove> moves;
+  while(inFlight > 0){
+    Response response;
+    if(!readAll(fd, &response, sizeof(response))) break;
+    moves.resize(response.count);
+    if(response.count && !readAll(fd, moves.data(), moves.size() * sizeof(WireMove))) break;
+
+    inFlight--;
+    GameState& game = games[response.id];
+    local.latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - game.sent).count());
+    local.requests++;
+    if(response.status != Ok && response.status != Illegal) local.errors++;
+
+    bool stopping = Clock::now() >= end;
+    Type ask = settings.thinkNodes ? Think : LegalMoves;
+    Type next = Close;
+    uint8_t from = 0, to = 0;
+
+    switch(game.pending){
+    case NewGame:
+      if(response.status != Ok){next = NewGame; break;}
+      game.game = response.game;
+      game.plies = 0;
+      next = ask;
+      break;
+
+    case LegalMoves:
+    case Think:
+      if(response.status != Ok) break;
+      if(game.pending == LegalMoves && response.count){
+	WireMove move = moves[random() % moves.size()];
+	from = move.from; to = move.to;
+	next = Move;
+      }else if(game.pending == Think && response.from != response.to){
+	from = response.from; to = response.to;
+	next = Move;
+      }
+      break;
+
+    case Move:
+      if(response.status != Ok) break;
+      game.plies++;
+      if(response.state == Checkmate || response.state == Stalemate || game.plies >= MAX_PLIES){
+	local.games++;
+	break;
+      }
+      next = ask;
+      break;
+
+    case Close:
+      next = NewGame;
+      break;
+    }
+
+    // wind down by closing every game, the connection ends once all are closed
+    if(stopping) next = (game.pending == Close || response.status == Full) ? NewGame : Close;
+    if(stopping && next == NewGame) continue;
+    if(!send(response.id, next, from, to)) break;
+    inFlight++;
+  }
+  close(fd);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  totals.latencies.insert(totals.latencies.end(), local.latencies.begin(), local.latencies.end());
+  totals.requests += local.requests;
+  totals.games += local.games;
+  totals.errors += local.errors;
+}
+
+bool parseArguments(int argc, char** argv, Settings& settings){
+  for(int i = 1; i < argc; i++){
+    std::string arg = argv[i];
+    if(i + 1 >= argc){std::cerr << "Missing value for " << arg << "\n"; return false;}
+    std::string value = argv[++i];
+
+    if(arg == "--socket") settings.socketPath = value;
+    else if(arg == "--connections") settings.connections = std::max(1, std::stoi(value));
+    else if(arg == "--games") settings.games = std::max(1, std::stoi(value));
+    else if(arg == "--seconds") settings.seconds = std::stod(value);
+    else if(arg == "--think") settings.thinkNodes = std::stoul(value);
+    else{std::cerr << "Unknown option " << arg << "\n"; return false;}
+  }
+  return true;
+}
+
+int main(int argc, char** argv){
+  Settings settings;
+  if(!parseArguments(argc, argv, settings)) return 1;
+
+  Totals totals;
+  std::mutex mutex;
+  auto start = Clock::now();
+
+  std::vector<std::thread> threads;
+  for(int i = 0; i < settings.connections; i++)
+    threads.emplace_back(runConnection, std::ref(settings), i + 1, std::ref(totals), std::ref(mutex));
+  for(auto& thread: threads) thread.join();
+
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  std::sort(totals.latencies.begin(), totals.latencies.end());
+  auto percentile = [&](double p){
+    if(totals.latencies.empty()) return 0u;
+    return totals.latencies[std::min(totals.latencies.size() - 1, (size_t)(p * totals.latencies.size()))];
+  };
+
+  std::cout << "Requests: " << totals.requests << " (" << totals.requests / elapsed << "/sec, "
+	    << totals.errors << " errors)\n"
+	    << "Round trip: p50 " << percentile(0.50) << " us, p99 " << percentile(0.99) << " us\n"
+	    << "Games: " << totals.games << " (" << totals.games / elapsed << "/sec over "
+	    << settings.connections * settings.games << " concurrent games)\n";
+  return totals.requests ? 0 : 1;
+}
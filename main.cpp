@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cmath>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
@@ -6,38 +7,196 @@
 #include "definitions.hpp"
 #include "gui.hpp"
 #include "chess.hpp"
+#include "history.hpp"
+#include "notation.hpp"
+#include "bench.hpp"
 
 bool running;
 
-SDL_Texture* texturePieces;
-SDL_Texture* textureTiles;
-
 GUI::Selection selection;
 GUI::Pickup picked;
 Mouse mouse;
+Bench::InputLatency inputLatency;
 
-Window* window = new Window();
+Window* window;
 SDL_Renderer* renderer;
 
 GameMode gameMode = Game;
 
 GUI::Board* boardElement = new GUI::Board();
 Chess::Board* board = new Chess::Board();
+History::Tree history;
 
-SDL_Point getTileIntersection(SDL_Point* point){
-  for(int i = 0; i < 8; i++)
-    for(int j = 0; j < 8; j++){
-      SDL_Rect rect = boardElement->getTileScreenRect({j, i});
-      
-      if(SDL_PointInRect(point, &rect)) return SDL_Point({j, i});
+Analysis::Worker* analysis = new Analysis::Worker();
+Analysis::Info analysisInfo;
+bool hasAnalysisInfo = false;
+GUI::AnalysisPanel analysisPanel;
+
+// Restarts background analysis, cancelling whatever is still running
+void positionChanged(){
+  analysis->analyze(*board);
+  hasAnalysisInfo = false;
+}
+
+// Takes the newest result for the current position, never waits
+void updateAnalysis(){
+  Analysis::Info info;
+  while(analysis->results.pop(info)){
+    if(info.generation != analysis->generation) continue;
+    analysisInfo = std::move(info);
+    hasAnalysisInfo = true;
+  }
+}
+
+// Every move goes through the history so it can be taken back
+void playMove(Chess::Piece piece, SDL_Point position, bool switchTurn){
+  history.play(*board, piece, position, switchTurn);
+  board->updateMoves();
+}
+
+Player::Computer* computer = new Player::Computer();
+Player::Clock gameClock;
+GUI::ClockDisplay clockDisplay;
+Chess::PieceColor computerColor = Chess::Black;
+bool gameOver = false;
+bool reviewing = false; // stepping through the history, computer and clock wait
+
+bool isComputerTurn(){
+  return COMPUTER_PLAYER && gameMode == Game && !gameOver && !reviewing && board->turn == computerColor;}
+
+// Ends the game on mate, or on stalemate as a draw
+void checkGameOver(){
+  bool mate = board->isMate(board->turn);
+  if(!mate && !board->legalMoves().empty()) return;
+  if(!mate) std::cout << "Stalemate! Draw\n";
+  else if(board->turn == Chess::White) std::cout << "Mate! Black wins\n";
+  else std::cout << "Mate! White wins\n";
+  if(gameMode == Game){
+    gameOver = true;
+    gameClock.halt();
+    computer->idle();
+  }
+}
+
+// Hands the turn over: punches the clock and lets the computer think,
+// unless it was already pondering on the move just played
+void startTurn(Chess::Move lastMove, bool hasLastMove){
+  if(!COMPUTER_PLAYER || gameMode != Game || gameOver) return;
+  gameClock.punch();
+  gameClock.start(board->turn);
+  if(!isComputerTurn()) return;
+
+  int64_t remaining = gameClock.timeLeft(computerColor);
+  if(hasLastMove && computer->ponderHit(lastMove, remaining, gameClock.increment)) return;
+  computer->think(*board, remaining, gameClock.increment);
+}
+
+void sideChanged(){
+  computerColor = !boardElement->side;
+  computer->idle();
+  if(isComputerTurn())
+    computer->think(*board, gameClock.timeLeft(computerColor), gameClock.increment);
+}
+
+void newGame(){
+  gameOver = false;
+  reviewing = false;
+  computer->idle();
+  computerColor = !boardElement->side;
+  gameClock.reset(CLOCK_BASE_MS, CLOCK_INCREMENT_MS);
+  startTurn({}, false);
+}
+
+void updateComputer(){
+  if(!COMPUTER_PLAYER || gameMode != Game || gameOver) return;
+  computer->checkTime();
+
+  if(gameClock.running && gameClock.flagged(gameClock.side)){
+    std::cout << "Time! " << ((gameClock.side == Chess::White) ? "Black" : "White") << " wins\n";
+    gameOver = true;
+    gameClock.halt();
+    computer->idle();
+    return;
+  }
+
+  Player::Result result;
+  while(computer->results.pop(result)){
+    if(result.generation != computer->generation || !isComputerTurn()) continue;
+    if(!result.hasMove){
+      checkGameOver();
+      continue;
     }
-  
-  return SDL_Point({-1, -1});
+
+    playMove(result.move.piece, result.move.to, true);
+    positionChanged();
+    checkGameOver();
+    startTurn({}, false);
+    if(!gameOver && result.hasPonderMove) computer->ponder(*board, result.ponderMove);
+  }
+}
+
+// After moving through the history. Plain navigation only reviews: the
+// computer and the clock pause until the user moves or takes back.
+void historyChanged(){
+  selection.any = false;
+  picked.any = false;
+  board->updateMoves();
+  positionChanged();
+
+  if(COMPUTER_PLAYER && gameMode == Game){
+    reviewing = true;
+    computer->idle();
+    gameClock.halt();
+  }
+}
+
+// Continues the game from the current position. A game lost on time stays lost.
+void resumeGame(){
+  reviewing = false;
+  if(!COMPUTER_PLAYER || gameMode != Game) return;
+  gameOver = gameClock.flagged(Chess::White) || gameClock.flagged(Chess::Black);
+  if(gameOver) return;
+  checkGameOver();
+  if(gameOver) return;
+  gameClock.start(board->turn);
+  if(isComputerTurn())
+    computer->think(*board, gameClock.timeLeft(computerColor), gameClock.increment);
+}
+
+// Takes back the last move, and the computer's reply before it when it has one
+void takeback(){
+  if(!history.undo(*board)) return;
+  if(COMPUTER_PLAYER && gameMode == Game && board->turn == computerColor) history.undo(*board);
+  historyChanged();
+  resumeGame();
+}
+
+void navigate(SDL_Keysym key){
+  bool ctrl = key.mod & KMOD_CTRL;
+  bool moved = false;
+  switch(key.sym){
+  case SDLK_LEFT: moved = history.undo(*board); break;
+  case SDLK_RIGHT: moved = history.redo(*board); break;
+  case SDLK_z: if(ctrl) moved = history.undo(*board); break;
+  case SDLK_y: if(ctrl) moved = history.redo(*board); break;
+  case SDLK_UP: moved = history.switchVariation(*board, -1); break;
+  case SDLK_DOWN: moved = history.switchVariation(*board, 1); break;
+  case SDLK_HOME: moved = !history.atStart(); history.toStart(*board); break;
+  case SDLK_END: moved = history.redo(*board); history.toEnd(*board); break;
+  case SDLK_BACKSPACE: takeback(); return;
+  }
+  if(moved) historyChanged();
 }
 
+SDL_Point getTileIntersection(SDL_Point* point){
+  return boardElement->getTileAt(*point);}
+
 
 // Returns whether or not the move was made
 bool makeMove(Chess::Piece piece, SDL_Point position){
+  // dropped inside the board element but off the 8x8 grid
+  if(position.x < 0 || position.y < 0) return false;
+
   if(gameMode == Game){
     std::vector<SDL_Point> moves = board->moves[piece];
     std::vector<SDL_Point> captureMoves = board->captureMoves[piece];
@@ -45,9 +204,7 @@ bool makeMove(Chess::Piece piece, SDL_Point position){
     if(!board->any(position)){
       for(auto& move: moves)
 	if(move == position){
-	  board->makeMove(piece, position);
-	  board->updateMoves();
-	  board->switchTurn();
+	  playMove(piece, position, true);
 	  return true;
 	}
       return false;
@@ -57,9 +214,7 @@ bool makeMove(Chess::Piece piece, SDL_Point position){
     
     for(auto& move: captureMoves){
       if(move == position){
-	board->makeMove(piece, position);
-	board->updateMoves();
-	board->switchTurn();
+	playMove(piece, position, true);
 	return true;
       }
     }
@@ -68,8 +223,7 @@ bool makeMove(Chess::Piece piece, SDL_Point position){
   
   } else if(gameMode == Free){
     if(!board->any(position) || ((*board)[position].color != piece.color)){
-      board->makeMove(piece, position);
-      board->updateMoves();
+      playMove(piece, position, false);
       return true;
     }
     return false;
@@ -84,19 +238,20 @@ void updatePickupOnUp(){
   
   if(!SDL_PointInRect(&mouse.position, &boardElement->position)) return;
   SDL_Point tile = getTileIntersection(&mouse.position);
+  if(tile.x < 0) return;
   
   bool moveWasMade = makeMove(picked.piece, tile);
   if(moveWasMade){
+    positionChanged();
     if(SWITCH_SIDE_MODE) boardElement->switchSide();
-    if(board->isMate(board->turn)){
-      std::cout << "Mate! ";
-      if(board->turn == Chess::White) std::cout << "Black wins\n";
-      else std::cout << "White wins\n";
-    }
+    checkGameOver();
+    reviewing = false;
+    startTurn({picked.piece, tile}, true);
   }
 }
 
 void updatePickupOnDown(){
+  if(isComputerTurn() || gameOver) return;
   if(!SDL_PointInRect(&mouse.position, &boardElement->position)) return;
   SDL_Point tile = getTileIntersection(&mouse.position);
   
@@ -114,6 +269,7 @@ void updatePickupOnDown(){
 void updateSelectionOnDown(){
 
   selection.any = false;
+  if(isComputerTurn() || gameOver) return;
   if(!SDL_PointInRect(&mouse.position, &boardElement->position)) return;
   SDL_Point tile = getTileIntersection(&mouse.position);
 
@@ -133,17 +289,29 @@ void updateSelectionOnUp(){
 }
 
 
-void handleInput(SDL_Event event){
-  window->updateOnResize();
+void updateLayout(){
   boardElement->updateOnResize(window);
+  atlas.update(renderer, boardElement->position.w / 8);
+  if(!atlas.texture) return;  // no glyphs to size the labels with
 
   resetButton.updateOnResize(window, boardElement);
   switchSideButton.updateOnResize(window, boardElement);
-  
+  analysisPanel.updateOnResize(window, boardElement);
+  clockDisplay.updateOnResize(resetButton, switchSideButton);
+}
+
+void handleInput(SDL_Event event){
   while(SDL_PollEvent(&event)){  
+    inputLatency.received(event);
     switch(event.type){
     case SDL_QUIT:
       running = false; break;
+    case SDL_WINDOWEVENT:
+      if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED){
+	window->updateOnResize();
+	updateLayout();
+      }
+      break;
     case SDL_MOUSEMOTION:
       mouse.position = {event.motion.x, event.motion.y};
       break;
@@ -154,9 +322,14 @@ void handleInput(SDL_Event event){
       if(SDL_PointInRect(&mouse.position, &resetButton.position)){
         boardElement->reset();
 	board->reset();
+	history.clear();
+	positionChanged();
+	newGame();
       }
-      if(SDL_PointInRect(&mouse.position, &switchSideButton.position))
+      if(SDL_PointInRect(&mouse.position, &switchSideButton.position)){
 	boardElement->switchSide();
+	sideChanged();
+      }
     
       break;
       
@@ -169,6 +342,7 @@ void handleInput(SDL_Event event){
       switch(event.key.keysym.sym){
       case SDLK_f: window->changeFullscreen(); break;
       case SDLK_q: running = false; break;
+      default: navigate(event.key.keysym); break;
       } break;
     }
   }
@@ -180,20 +354,18 @@ void renderTiles(){
     for(int j = 0; j < 8; j++) {
       SDL_Rect tileDstRect = boardElement->getTileScreenRect({j, i});
       
-      SDL_Rect tileSrcRect = {0, 0, SPRITE_TILE_SIZE, SPRITE_TILE_SIZE};
-      if(!Chess::isWhite({j, i})) tileSrcRect.y += SPRITE_TILE_SIZE;
-      SDL_RenderCopy(renderer, textureTiles, &tileSrcRect, &tileDstRect);
+      SDL_Rect tileSrcRect = atlas.tileRect(0, Chess::isWhite({j, i}) ? 0 : 1);
+      RenderCopy(renderer, atlas.texture, &tileSrcRect, &tileDstRect);
     }
 
   
   if(selection.any){
-    SDL_Rect tileSrcRect = {SPRITE_TILE_SIZE, 0, SPRITE_TILE_SIZE, SPRITE_TILE_SIZE};;
-    if(!Chess::isWhite(selection.piece.position)) tileSrcRect.y += SPRITE_TILE_SIZE;
+    SDL_Rect tileSrcRect = atlas.tileRect(1, Chess::isWhite(selection.piece.position) ? 0 : 1);
 
     
     SDL_Rect tileDstRect = boardElement->getTileScreenRect(selection.piece.position);
 
-    SDL_RenderCopy(renderer, textureTiles, &tileSrcRect, &tileDstRect);
+    RenderCopy(renderer, atlas.texture, &tileSrcRect, &tileDstRect);
 
     
     std::vector<SDL_Point> moves = board->moves[selection.piece];
@@ -201,26 +373,29 @@ void renderTiles(){
 
     for(auto& move: moves){
       tileDstRect = boardElement->getTileScreenRect({move.x, move.y});
-      tileSrcRect = {2*SPRITE_TILE_SIZE, 0, SPRITE_TILE_SIZE, SPRITE_TILE_SIZE};
+      tileSrcRect = atlas.tileRect(2, 0);
       
-      SDL_RenderCopy(renderer, textureTiles, &tileSrcRect, &tileDstRect);
+      RenderCopy(renderer, atlas.texture, &tileSrcRect, &tileDstRect);
     }
     
     for(auto& move: captureMoves){
       tileDstRect = boardElement->getTileScreenRect({move.x, move.y});
-      tileSrcRect = {2*SPRITE_TILE_SIZE, SPRITE_TILE_SIZE, SPRITE_TILE_SIZE, SPRITE_TILE_SIZE};
+      tileSrcRect = atlas.tileRect(2, 1);
       
-      SDL_RenderCopy(renderer, textureTiles, &tileSrcRect, &tileDstRect);
+      RenderCopy(renderer, atlas.texture, &tileSrcRect, &tileDstRect);
+
+      if(SEE_HIGHLIGHT_MODE){
+	int exchange = board->see({selection.piece, move});
+	SetRenderDrawColor(renderer, exchange >= 0 ? WINNING_CAPTURE_COLOR : LOSING_CAPTURE_COLOR);
+	RenderFillRect(renderer, &tileDstRect);
+      }
     }
   }
   
 }
 
 SDL_Rect getPieceSrcRect(Chess::Piece& piece){
-  return {
-    piece.spritePosition.x*SPRITE_PIECE_SIZE,
-    piece.spritePosition.y*SPRITE_PIECE_SIZE,
-    SPRITE_PIECE_SIZE, SPRITE_PIECE_SIZE};}
+  return atlas.pieceRect(piece.spritePosition);}
 
 SDL_Rect getPieceDstRect(Chess::Piece& piece){
   return boardElement->getTileScreenRect(piece.position);}
@@ -233,7 +408,7 @@ void renderPieces(){
     SDL_Rect pieceSrcRect = getPieceSrcRect(piece);
     SDL_Rect pieceDstRect = getPieceDstRect(piece);
 
-    SDL_RenderCopy(renderer, texturePieces, &pieceSrcRect, &pieceDstRect);    
+    RenderCopy(renderer, atlas.texture, &pieceSrcRect, &pieceDstRect);    
   }
 
   if(picked.any){
@@ -243,41 +418,190 @@ void renderPieces(){
     pieceDstRect.x += mouse.position.x - picked.position.x;
     pieceDstRect.y += mouse.position.y - picked.position.y;
 
-    SDL_RenderCopy(renderer, texturePieces, &pieceSrcRect, &pieceDstRect);  
+    RenderCopy(renderer, atlas.texture, &pieceSrcRect, &pieceDstRect);  
+  }
+
+}
+
+void renderFrame(Bench::FrameProfile* profile = nullptr){
+  SetRenderDrawColor(renderer, BACKGROUND_COLOR);
+  SDL_RenderClear(renderer);
+
+  Bench::measure(profile ? &profile->tiles : nullptr, renderTiles);
+  Bench::measure(profile ? &profile->pieces : nullptr, renderPieces);
+  Bench::measure(profile ? &profile->buttons : nullptr, [](){
+    resetButton.render(renderer);
+    switchSideButton.render(renderer);
+  });
+  Bench::measure(profile ? &profile->panels : nullptr, [](){
+    analysisPanel.render(renderer, analysisInfo, hasAnalysisInfo);
+    if(COMPUTER_PLAYER && gameMode == Game) clockDisplay.render(renderer, gameClock, boardElement);
+  });
+  if(profile) profile->frames++;
+}
+
+/* ---------------- Rendering benchmark ---------------- */
+
+SDL_Texture* benchTarget = nullptr;
+
+// The texture is only replaced when the size actually changes
+void resizeBenchTarget(int w, int h){
+  int currentW = 0, currentH = 0;
+  if(benchTarget) SDL_QueryTexture(benchTarget, nullptr, nullptr, &currentW, &currentH);
+  if(currentW != w || currentH != h){
+    if(benchTarget) SDL_DestroyTexture(benchTarget);
+    benchTarget = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, w, h);
+    SDL_SetRenderTarget(renderer, benchTarget);
+  }
+  window->position.w = w;
+  window->position.h = h;
+  updateLayout();
+}
+
+void printSection(const char* name, Bench::Section& section, int frames){
+  std::cout << "  " << name << ": " << 1000.0 * section.seconds / frames << " ms, "
+	    << (double)section.drawCalls / frames << " draw calls per frame\n";
+}
+
+std::vector<Bench::Result> benchResults;
+
+// Plays one scripted scenario; `step` sets up frame i before it is drawn
+template <typename F>
+void runScenario(const char* name, int frames, bool checksum, F step){
+  Bench::FrameProfile profile;
+  auto start = std::chrono::steady_clock::now();
+  for(int i = 0; i < frames; i++){
+    step(i);
+    renderFrame(&profile);
   }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << name << ": " << frames / elapsed << " frames/sec\n";
+  printSection("tiles", profile.tiles, frames);
+  printSection("pieces", profile.pieces, frames);
+  printSection("buttons", profile.buttons, frames);
+  printSection("panels", profile.panels, frames);
+  uint64_t hash = checksum ? Bench::frameChecksum(renderer) : 0;
+  if(checksum) std::cout << "  checksum: " << std::hex << hash << std::dec << "\n";
+  benchResults.push_back({name, frames / elapsed, hash});
+}
+
+// Renders scripted scenarios into an offscreen texture with the software
+// renderer and the dummy video driver, no window is ever shown. With a
+// baseline file the run is compared against it, or recorded when there is
+// none yet.
+int runBenchmark(int frames, bool checksum, std::string baselinePath){
+  renderer = SDL_CreateRenderer(window->sdlWindow, -1, SDL_RENDERER_SOFTWARE | SDL_RENDERER_TARGETTEXTURE);
+  if(!renderer){std::cout << "No renderer: " << SDL_GetError() << "\n"; return 1;}
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+  IMG_Init(IMG_INIT_PNG);
+  TTF_Init();
+  gameClock.reset(CLOCK_BASE_MS, CLOCK_INCREMENT_MS);
+
+  resizeBenchTarget(1200, 800);
+  if(!atlas.texture){std::cout << "Cannot build the sprite atlas\n"; return 1;}
+
+  runScenario("idle", frames, checksum, [](int){});
+
+  runScenario("drag", frames, checksum, [](int i){
+    SDL_Rect from = boardElement->getTileScreenRect({4, 1});
+    picked.any = true;
+    picked.piece = (*board)[{4, 1}];
+    picked.position = {from.x + from.w/2, from.y + from.h/2};
+    int radius = boardElement->position.w / 4;
+    mouse.position = {picked.position.x + (int)(radius * std::cos(i * 0.1)),
+		      picked.position.y + (int)(radius * std::sin(i * 0.1))};
+  });
+  picked.any = false;
 
+  runScenario("resize", frames, checksum, [](int i){
+    static const SDL_Point sizes[] = {{1200, 800}, {1600, 900}, {800, 600}, {1920, 1080}};
+    SDL_Point size = sizes[i % 4];
+    resizeBenchTarget(size.x, size.y);
+  });
+  resizeBenchTarget(1200, 800);
+
+  Notation::loadFen(*board, "3k4/6p1/1p6/8/3Q4/8/5p2/3K4 w");
+  runScenario("highlights", frames, checksum, [](int){
+    selection.any = true;
+    selection.piece = (*board)[{3, 3}];
+  });
+
+  if(baselinePath.empty()) return 0;
+  std::vector<Bench::Result> baseline;
+  if(Bench::loadBaseline(baselinePath, baseline)){
+    std::cout << "\nAgainst " << baselinePath << ":\n";
+    Bench::compare(baseline, benchResults);
+  }else{
+    Bench::saveBaseline(baselinePath, benchResults);
+    std::cout << "\nBaseline recorded in " << baselinePath << "\n";
+  }
+  return 0;
 }
 
-int main(){
+int main(int argc, char** argv){
+  bool bench = false, checksum = false, latency = false;
+  int benchFrames = 300;
+  std::string baselinePath;
+  for(int i = 1; i < argc; i++){
+    std::string arg = argv[i];
+    if(arg == "--bench") bench = true;
+    else if(arg == "--checksum") checksum = true;
+    else if(arg == "--latency") latency = true;
+    else if(arg == "--frames" && i + 1 < argc) benchFrames = std::max(1, std::stoi(argv[++i]));
+    else if(arg == "--baseline" && i + 1 < argc) baselinePath = argv[++i];
+  }
+
+  if(bench) SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+  window = new Window();
+
+  if(bench) return runBenchmark(benchFrames, checksum, baselinePath);
+
   std::cout << "Hello, world!" << std::endl; 
 
   renderer = SDL_CreateRenderer(window->sdlWindow, -1, 0);
+  if(latency) inputLatency.enable(window->sdlWindow);
+  SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
 
   SetRenderDrawColor(renderer, BACKGROUND_COLOR);
   SDL_RenderClear(renderer);
   SDL_RenderPresent(renderer);
 
+  // the atlas is built (or read from atlas-cache/) on the first layout,
+  // afterwards only SDL_WINDOWEVENT_SIZE_CHANGED recomputes the layout
   IMG_Init(IMG_INIT_PNG);
-  
-  texturePieces = loadTexture(renderer, "pieces.png");
-  textureTiles = loadTexture(renderer, "tiles.png");
-
   TTF_Init();
-  font = TTF_OpenFont("./SpaceMono-Regular.ttf", 200);
+  window->updateOnResize();
+  updateLayout();
+  if(!atlas.texture){
+    std::cout << "Cannot build the sprite atlas: " << Atlas::PiecesPath << ", " << Atlas::TilesPath
+	      << " and " << Atlas::FontPath << " must be readable" << std::endl;
+    return 1;
+  }
+
+  board->setNetwork(NNUE::load("network.nnue"));
+
+  analysis->start();
+  positionChanged();
+
+  computer->start();
+  newGame();
 
   SDL_Event event;
   running = true;
   while(running){
 
     handleInput(event);
-    
-    SetRenderDrawColor(renderer, BACKGROUND_COLOR);
-    SDL_RenderClear(renderer);
+    updateAnalysis();
+    updateComputer();
 
-    renderTiles();
-    renderPieces();
-    resetButton.render(renderer);
-    switchSideButton.render(renderer);
+    renderFrame();
     SDL_RenderPresent(renderer);
+    inputLatency.presented();
   }
+  inputLatency.report();
+
+  analysis->stop();
+  computer->stop();
 }
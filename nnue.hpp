@@ -0,0 +1,288 @@
+#ifndef NNUE_HPP
+#define NNUE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// The SIMD kernels exist on x86 only, elsewhere everything runs the scalar one
+#if defined(__x86_64__) || defined(__i386__)
+#define NNUE_X86 1
+#include <immintrin.h>
+#endif
+
+// Small HalfKP-like network: (king square, piece, square) features per
+// perspective feed an int16 accumulator, followed by two clipped-ReLU int8
+// layers and a single output. Feature indices are computed by Chess::Board,
+// this header only knows about numbers.
+namespace NNUE{
+
+const int KingSquares = 64;
+const int PieceKinds = 10; // 5 non-king pieces x (own, enemy)
+const int Squares = 64;
+const int InputSize = KingSquares * PieceKinds * Squares;
+
+const int HalfSize = 128;
+const int Hidden1 = 32;
+const int Hidden2 = 32;
+
+const int ActivationMax = 127;
+const int WeightShift = 6;
+const int OutputScale = 16;
+
+const uint32_t FileVersion = 1;
+
+struct Network{
+  std::vector<int16_t> featureBiases = std::vector<int16_t>(HalfSize);
+  std::vector<int16_t> featureWeights = std::vector<int16_t>((size_t)InputSize * HalfSize);
+  std::vector<int32_t> l1Biases = std::vector<int32_t>(Hidden1);
+  std::vector<int8_t> l1Weights = std::vector<int8_t>(Hidden1 * 2 * HalfSize);
+  std::vector<int32_t> l2Biases = std::vector<int32_t>(Hidden2);
+  std::vector<int8_t> l2Weights = std::vector<int8_t>(Hidden2 * Hidden1);
+  int32_t outBias = 0;
+  std::vector<int8_t> outWeights = std::vector<int8_t>(Hidden2);
+};
+
+struct Accumulator{
+  alignas(32) int16_t values[2][HalfSize];
+};
+
+enum Kernel{Scalar, SSE41, AVX2};
+
+
+template <typename T>
+bool readArray(std::ifstream& file, std::vector<T>& array){
+  return (bool)file.read((char*)array.data(), array.size() * sizeof(T));}
+
+// File layout (little endian): "NNUE", version, HalfSize, Hidden1, Hidden2,
+// then every array of Network in declaration order.
+// Returns nullptr if the file is missing or doesn't match this build.
+Network* load(std::string path){
+  std::ifstream file(path, std::ios::binary);
+  if(!file) return nullptr;
+
+  char magic[4];
+  uint32_t header[4];
+  if(!file.read(magic, 4) || std::memcmp(magic, "NNUE", 4) != 0) return nullptr;
+  if(!file.read((char*)header, sizeof(header))) return nullptr;
+  if(header[0] != FileVersion || header[1] != HalfSize ||
+     header[2] != Hidden1 || header[3] != Hidden2) return nullptr;
+
+  Network* network = new Network();
+  bool ok =
+    readArray(file, network->featureBiases) &&
+    readArray(file, network->featureWeights) &&
+    readArray(file, network->l1Biases) &&
+    readArray(file, network->l1Weights) &&
+    readArray(file, network->l2Biases) &&
+    readArray(file, network->l2Weights) &&
+    file.read((char*)&network->outBias, sizeof(int32_t)) &&
+    readArray(file, network->outWeights);
+
+  if(!ok){delete network; return nullptr;}
+  return network;
+}
+
+
+bool cpuHas(Kernel kernel){
+  switch(kernel){
+  case Scalar: return true;
+#ifdef NNUE_X86
+  case SSE41: return __builtin_cpu_supports("sse4.1");
+  case AVX2: return __builtin_cpu_supports("avx2");
+#else
+  case SSE41: case AVX2: return false;
+#endif
+  }
+  return false;
+}
+
+Kernel bestKernel(){
+  static Kernel kernel = cpuHas(AVX2) ? AVX2 : (cpuHas(SSE41) ? SSE41 : Scalar);
+  return kernel;
+}
+
+
+/* ---------------- Scalar reference ---------------- */
+
+void addFeatureScalar(const Network& net, int16_t* values, int index, int sign){
+  const int16_t* w = &net.featureWeights[(size_t)index * HalfSize];
+  for(int i = 0; i < HalfSize; i++) values[i] = (int16_t)(values[i] + sign * w[i]);
+}
+
+void transformScalar(const int16_t* values, uint8_t* out){
+  for(int i = 0; i < HalfSize; i++){
+    int v = values[i];
+    out[i] = (uint8_t)(v < 0 ? 0 : (v > ActivationMax ? ActivationMax : v));
+  }
+}
+
+int32_t dotScalar(const uint8_t* input, const int8_t* weights, int size){
+  int32_t sum = 0;
+  for(int i = 0; i < size; i++) sum += (int32_t)input[i] * (int32_t)weights[i];
+  return sum;
+}
+
+
+#ifdef NNUE_X86
+
+/* ---------------- SSE4.1 ---------------- */
+
+__attribute__((target("sse4.1")))
+void addFeatureSSE41(const Network& net, int16_t* values, int index, int sign){
+  const int16_t* w = &net.featureWeights[(size_t)index * HalfSize];
+  for(int i = 0; i < HalfSize; i += 8){
+    __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+    __m128i d = _mm_loadu_si128((const __m128i*)(w + i));
+    v = (sign > 0) ? _mm_add_epi16(v, d) : _mm_sub_epi16(v, d);
+    _mm_storeu_si128((__m128i*)(values + i), v);
+  }
+}
+
+__attribute__((target("sse4.1")))
+void transformSSE41(const int16_t* values, uint8_t* out){
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i max = _mm_set1_epi16(ActivationMax);
+  for(int i = 0; i < HalfSize; i += 16){
+    __m128i a = _mm_loadu_si128((const __m128i*)(values + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(values + i + 8));
+    a = _mm_min_epi16(_mm_max_epi16(a, zero), max);
+    b = _mm_min_epi16(_mm_max_epi16(b, zero), max);
+    _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+  }
+}
+
+// Inputs are widened to int16 before multiplying, so unlike maddubs nothing
+// can saturate and the result matches dotScalar exactly.
+__attribute__((target("sse4.1")))
+int32_t dotSSE41(const uint8_t* input, const int8_t* weights, int size){
+  __m128i sum = _mm_setzero_si128();
+  for(int i = 0; i < size; i += 8){
+    __m128i in = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(input + i)));
+    __m128i w = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)(weights + i)));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(in, w));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+
+/* ---------------- AVX2 ---------------- */
+
+__attribute__((target("avx2")))
+void addFeatureAVX2(const Network& net, int16_t* values, int index, int sign){
+  const int16_t* w = &net.featureWeights[(size_t)index * HalfSize];
+  for(int i = 0; i < HalfSize; i += 16){
+    __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(w + i));
+    v = (sign > 0) ? _mm256_add_epi16(v, d) : _mm256_sub_epi16(v, d);
+    _mm256_storeu_si256((__m256i*)(values + i), v);
+  }
+}
+
+__attribute__((target("avx2")))
+void transformAVX2(const int16_t* values, uint8_t* out){
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i max = _mm256_set1_epi16(ActivationMax);
+  for(int i = 0; i < HalfSize; i += 32){
+    __m256i a = _mm256_loadu_si256((const __m256i*)(values + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(values + i + 16));
+    a = _mm256_min_epi16(_mm256_max_epi16(a, zero), max);
+    b = _mm256_min_epi16(_mm256_max_epi16(b, zero), max);
+    // packus works per 128-bit lane, put the quarters back in order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+    _mm256_storeu_si256((__m256i*)(out + i), packed);
+  }
+}
+
+__attribute__((target("avx2")))
+int32_t dotAVX2(const uint8_t* input, const int8_t* weights, int size){
+  __m256i sum = _mm256_setzero_si256();
+  for(int i = 0; i < size; i += 16){
+    __m256i in = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(input + i)));
+    __m256i w = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(weights + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(in, w));
+  }
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+  return _mm_cvtsi128_si32(s);
+}
+
+#endif
+
+/* ---------------- Dispatch ---------------- */
+
+void addFeature(const Network& net, int16_t* values, int index, int sign, Kernel kernel = bestKernel()){
+  switch(kernel){
+#ifdef NNUE_X86
+  case AVX2: addFeatureAVX2(net, values, index, sign); return;
+  case SSE41: addFeatureSSE41(net, values, index, sign); return;
+#endif
+  default: addFeatureScalar(net, values, index, sign); return;
+  }
+}
+
+void transform(const int16_t* values, uint8_t* out, Kernel kernel){
+  switch(kernel){
+#ifdef NNUE_X86
+  case AVX2: transformAVX2(values, out); return;
+  case SSE41: transformSSE41(values, out); return;
+#endif
+  default: transformScalar(values, out); return;
+  }
+}
+
+int32_t dot(const uint8_t* input, const int8_t* weights, int size, Kernel kernel){
+  switch(kernel){
+#ifdef NNUE_X86
+  case AVX2: return dotAVX2(input, weights, size);
+  case SSE41: return dotSSE41(input, weights, size);
+#endif
+  default: return dotScalar(input, weights, size);
+  }
+}
+
+uint8_t clippedReLU(int32_t sum){
+  sum >>= WeightShift;
+  return (uint8_t)(sum < 0 ? 0 : (sum > ActivationMax ? ActivationMax : sum));
+}
+
+
+void reset(const Network& net, Accumulator& acc, int perspective){
+  std::memcpy(acc.values[perspective], net.featureBiases.data(), sizeof(acc.values[perspective]));}
+
+void add(const Network& net, Accumulator& acc, int perspective, int index){
+  addFeature(net, acc.values[perspective], index, 1);}
+
+void remove(const Network& net, Accumulator& acc, int perspective, int index){
+  addFeature(net, acc.values[perspective], index, -1);}
+
+
+// Score in centipawns from the point of view of `perspective` (the side to move).
+// Every kernel produces bit-identical results, Scalar is the reference.
+int evaluate(const Network& net, const Accumulator& acc, int perspective, Kernel kernel = bestKernel()){
+  alignas(32) uint8_t input[2 * HalfSize];
+  alignas(32) uint8_t hidden1[Hidden1];
+  alignas(32) uint8_t hidden2[Hidden2];
+
+  transform(acc.values[perspective], input, kernel);
+  transform(acc.values[1 - perspective], input + HalfSize, kernel);
+
+  for(int j = 0; j < Hidden1; j++)
+    hidden1[j] = clippedReLU(net.l1Biases[j] +
+			     dot(input, &net.l1Weights[j * 2 * HalfSize], 2 * HalfSize, kernel));
+
+  for(int j = 0; j < Hidden2; j++)
+    hidden2[j] = clippedReLU(net.l2Biases[j] +
+			     dot(hidden1, &net.l2Weights[j * Hidden1], Hidden1, kernel));
+
+  return (net.outBias + dot(hidden2, net.outWeights.data(), Hidden2, kernel)) / OutputScale;
+}
+
+}
+
+#endif
@@ -0,0 +1,158 @@
+// NNUE consistency check on a random network. Every SIMD kernel the CPU
+// supports must match the scalar reference bit for bit (feature updates,
+// clipped ReLU, dot products and whole evaluations), and the accumulator
+// after incremental makeMove/unmakeMove must equal a full refresh.
+// Exits nonzero on the first kind of mismatch found.
+//
+//   ./nnue_test --games 200 --seed 1
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <cstring>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "definitions.hpp"
+#include "chess.hpp"
+
+const NNUE::Kernel KERNELS[] = {NNUE::SSE41, NNUE::AVX2};
+const char* KERNEL_NAMES[] = {"scalar", "sse4.1", "avx2"};
+
+template <typename T>
+void randomize(std::vector<T>& values, std::mt19937& random, int low, int high){
+  for(T& value: values) value = (T)(low + (int)(random() % (high - low + 1)));
+}
+
+// Weights wide enough to drive the accumulator and every layer into both
+// ends of the clipped ReLU
+NNUE::Network* randomNetwork(std::mt19937& random){
+  NNUE::Network* network = new NNUE::Network();
+  randomize(network->featureBiases, random, -40, 80);
+  randomize(network->featureWeights, random, -60, 60);
+  randomize(network->l1Biases, random, -4000, 4000);
+  randomize(network->l1Weights, random, -128, 127);
+  randomize(network->l2Biases, random, -4000, 4000);
+  randomize(network->l2Weights, random, -128, 127);
+  randomize(network->outWeights, random, -128, 127);
+  network->outBias = (int32_t)(random() % 20000) - 10000;
+  return network;
+}
+
+// Kernel against the scalar reference on random accumulators, returns mismatches
+int compareKernel(NNUE::Network& network, NNUE::Kernel kernel, std::mt19937& random, int rounds){
+  int mismatches = 0;
+  for(int round = 0; round < rounds; round++){
+    NNUE::Accumulator reference, candidate;
+    for(auto& half: reference.values)
+      for(int16_t& value: half) value = (int16_t)random(); // full int16 range, wraps included
+    candidate = reference;
+
+    int index = random() % NNUE::InputSize, sign = (random() & 1) ? 1 : -1;
+    for(int perspective = 0; perspective < 2; perspective++){
+      NNUE::addFeature(network, reference.values[perspective], index, sign, NNUE::Scalar);
+      NNUE::addFeature(network, candidate.values[perspective], index, sign, kernel);
+    }
+    if(std::memcmp(&reference, &candidate, sizeof(reference))) mismatches++;
+
+    alignas(32) uint8_t expected[NNUE::HalfSize], actual[NNUE::HalfSize];
+    NNUE::transform(reference.values[0], expected, NNUE::Scalar);
+    NNUE::transform(reference.values[0], actual, kernel);
+    if(std::memcmp(expected, actual, sizeof(expected))) mismatches++;
+
+    int size = 2 * NNUE::HalfSize;
+    alignas(32) uint8_t input[2 * NNUE::HalfSize];
+    for(uint8_t& value: input) value = random() % (NNUE::ActivationMax + 1);
+    const int8_t* weights = &network.l1Weights[(random() % NNUE::Hidden1) * size];
+    if(NNUE::dot(input, weights, size, NNUE::Scalar) != NNUE::dot(input, weights, size, kernel)) mismatches++;
+
+    for(int perspective = 0; perspective < 2; perspective++)
+      if(NNUE::evaluate(network, reference, perspective, NNUE::Scalar) !=
+	 NNUE::evaluate(network, reference, perspective, kernel)) mismatches++;
+  }
+  return mismatches;
+}
+
+// Random games played and taken back move by move, returns mismatches
+int compareIncremental(NNUE::Network& network, std::mt19937& random, int games, int& checks){
+  int mismatches = 0;
+  Chess::Board board;
+  board.setNetwork(&network);
+
+  auto check = [&](){
+    NNUE::Accumulator incremental = board.accumulator;
+    board.refreshAccumulator();
+    checks++;
+    if(std::memcmp(&incremental, &board.accumulator, sizeof(incremental))){
+      mismatches++;
+      board.accumulator = incremental; // keep going from the same state
+    }
+  };
+
+  typedef struct{
+    Chess::Piece piece;
+    SDL_Point from;
+    bool captured;
+    Chess::Piece victim;
+  } Played;
+
+  for(int game = 0; game < games; game++){
+    board.reset();
+    std::vector<Played> played;
+    for(int ply = 0; ply < 120; ply++){
+      std::vector<Chess::Move> legal = board.legalMoves();
+      if(legal.empty()) break;
+      Chess::Move move = legal[random() % legal.size()];
+
+      Played entry = {move.piece, move.piece.position, board.any(move.to), board[move.to]};
+      board.makeMove(move.piece, move.to);
+      board.switchTurn();
+      entry.piece.position = move.to;
+      played.push_back(entry);
+      check();
+    }
+
+    while(!played.empty()){
+      Played& entry = played.back();
+      board.unmakeMove(entry.piece, entry.from, entry.captured, entry.victim);
+      board.switchTurn();
+      played.pop_back();
+      check();
+    }
+  }
+  return mismatches;
+}
+
+int main(int argc, char** argv){
+  int games = 200;
+  int rounds = 20000;
+  unsigned seed = 1;
+  for(int i = 1; i + 1 < argc; i += 2){
+    std::string arg = argv[i];
+    if(arg == "--games") games = std::stoi(argv[i + 1]);
+    else if(arg == "--rounds") rounds = std::stoi(argv[i + 1]);
+    else if(arg == "--seed") seed = std::stoul(argv[i + 1]);
+    else{std::cerr << "Unknown option " << arg << "\n"; return 2;}
+  }
+
+  std::mt19937 random(seed);
+  NNUE::Network* network = randomNetwork(random);
+  bool failed = false;
+
+  for(NNUE::Kernel kernel: KERNELS){
+    if(!NNUE::cpuHas(kernel)){std::cout << KERNEL_NAMES[kernel] << ": not available on this machine, skipped\n"; continue;}
+    int mismatches = compareKernel(*network, kernel, random, rounds);
+    std::cout << KERNEL_NAMES[kernel] << " against scalar: " << rounds << " rounds, " << mismatches << " mismatches\n";
+    if(mismatches) failed = true;
+  }
+
+  int checks = 0;
+  int mismatches = compareIncremental(*network, random, games, checks);
+  std::cout << "Incremental against refresh: " << checks << " positions, " << mismatches << " mismatches\n";
+  if(mismatches) failed = true;
+
+  delete network;
+  std::cout << (failed ? "FAIL\n" : "OK\n");
+  return failed ? 1 : 0;
+}
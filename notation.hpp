@@ -0,0 +1,153 @@
+#ifndef NOTATION_HPP
+#define NOTATION_HPP
+
+#include <cctype>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "chess.hpp"
+
+// FEN and SAN for Chess::Board. File a is x = 0 and rank 1 is y = 0.
+// The board knows nothing about castling, en passant or promotion, so those
+// FEN fields are ignored and such moves never appear.
+namespace Notation{
+
+char pieceLetter(Chess::PieceName name){
+  static const char letters[] = {'R', 'N', 'B', 'K', 'Q', 'P'}; // indexed by PieceName
+  return letters[name];
+}
+
+bool pieceFromLetter(char letter, Chess::PieceName& name){
+  switch(std::toupper(letter)){
+  case 'R': name = Chess::Rook; return true;
+  case 'N': name = Chess::Knight; return true;
+  case 'B': name = Chess::Bishop; return true;
+  case 'K': name = Chess::King; return true;
+  case 'Q': name = Chess::Queen; return true;
+  case 'P': name = Chess::Pawn; return true;
+  }
+  return false;
+}
+
+// Reads piece placement and side to move, the rest of a FEN or EPD line is ignored
+bool loadFen(Chess::Board& board, const std::string& fen){
+  std::istringstream in(fen);
+  std::string placement, side;
+  if(!(in >> placement >> side)) return false;
+
+  std::vector<Chess::Piece> pieces;
+  int x = 0, y = 7;
+  for(char c: placement){
+    if(c == '/'){y--; x = 0; continue;}
+    if(std::isdigit((unsigned char)c)){x += c - '0'; continue;}
+
+    Chess::PieceName name;
+    if(!pieceFromLetter(c, name) || x > 7 || y < 0) return false;
+    Chess::PieceColor color = std::isupper((unsigned char)c) ? Chess::White : Chess::Black;
+    pieces.push_back({name, color, {x, y}, Chess::spritePositionOf(name, color)});
+    x++;
+  }
+  if(y != 0 || (side != "w" && side != "b")) return false;
+
+  board.pieces = pieces;
+  board.turn = (side == "w") ? Chess::White : Chess::Black;
+  board.refreshAccumulator();
+  board.updateMoves();
+  return true;
+}
+
+std::string fen(Chess::Board& board){
+  std::string placement;
+  for(int y = 7; y >= 0; y--){
+    int empty = 0;
+    for(int x = 0; x < 8; x++){
+      if(!board.any({x, y})){empty++; continue;}
+      if(empty){placement += (char)('0' + empty); empty = 0;}
+      Chess::Piece piece = board[{x, y}];
+      char letter = pieceLetter(piece.name);
+      placement += (piece.color == Chess::White) ? letter : (char)std::tolower(letter);
+    }
+    if(empty) placement += (char)('0' + empty);
+    if(y) placement += '/';
+  }
+  return placement + ((board.turn == Chess::White) ? " w - - 0 1" : " b - - 0 1");
+}
+
+// `move` must be legal in `board`
+std::string san(Chess::Board& board, Chess::Move move){
+  std::string text;
+  bool capture = board.any(move.to);
+
+  if(move.piece.name == Chess::Pawn){
+    if(capture) text += (char)('a' + move.piece.position.x);
+  }else{
+    text += pieceLetter(move.piece.name);
+
+    bool ambiguous = false, sameFile = false, sameRank = false;
+    for(auto& other: board.legalMoves()){
+      if(other.piece.name != move.piece.name || !(other.to == move.to) ||
+	 other.piece.position == move.piece.position) continue;
+      ambiguous = true;
+      if(other.piece.position.x == move.piece.position.x) sameFile = true;
+      if(other.piece.position.y == move.piece.position.y) sameRank = true;
+    }
+    if(ambiguous && (!sameFile || sameRank)) text += (char)('a' + move.piece.position.x);
+    if(ambiguous && sameFile) text += (char)('1' + move.piece.position.y);
+  }
+
+  if(capture) text += 'x';
+  text += Chess::squareName(move.to);
+
+  std::vector<Chess::Piece> savedPieces = board.pieces;
+  board.movePiece(move.piece, move.to);
+  board.switchTurn();
+  if(board.isKingInCheck(board.turn))
+    text += board.legalMoves().empty() ? '#' : '+';
+  board.pieces = savedPieces;
+  board.switchTurn();
+
+  return text;
+}
+
+// Finds the legal move `text` stands for. Castling and promotions can't be
+// played on this board, so they are rejected like any unknown move.
+bool parseSan(Chess::Board& board, std::string text, Chess::Move& move){
+  while(!text.empty() && std::string("+#!?").find(text.back()) != std::string::npos) text.pop_back();
+  if(text.size() < 2 || text[0] == 'O' || text.find('=') != std::string::npos) return false;
+
+  Chess::PieceName name = Chess::Pawn;
+  size_t start = 0;
+  if(std::isupper((unsigned char)text[0])){
+    if(!pieceFromLetter(text[0], name) || name == Chess::Pawn) return false;
+    start = 1;
+  }
+
+  std::string target = text.substr(text.size() - 2);
+  if(target[0] < 'a' || target[0] > 'h' || target[1] < '1' || target[1] > '8') return false;
+  SDL_Point to = {target[0] - 'a', target[1] - '1'};
+
+  // whatever is left between piece letter and target disambiguates
+  int file = -1, rank = -1;
+  for(size_t i = start; i < text.size() - 2; i++){
+    char c = text[i];
+    if(c >= 'a' && c <= 'h') file = c - 'a';
+    else if(c >= '1' && c <= '8') rank = c - '1';
+    else if(c != 'x') return false;
+  }
+
+  bool found = false;
+  for(auto& candidate: board.legalMoves()){
+    if(candidate.piece.name != name || !(candidate.to == to)) continue;
+    if(file >= 0 && candidate.piece.position.x != file) continue;
+    if(rank >= 0 && candidate.piece.position.y != rank) continue;
+    if(found) return false; // still ambiguous
+    move = candidate;
+    found = true;
+  }
+  return found;
+}
+
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef PLAYER_HPP
+#define PLAYER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "chess.hpp"
+#include "engine.hpp"
+#include "analysis.hpp"
+
+namespace Player{
+
+int64_t milliseconds(){
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();}
+
+// Base time plus increment per side, in milliseconds
+struct Clock{
+  int64_t remaining[2] = {0, 0}; // indexed by PieceColor
+  int64_t increment = 0;
+  bool running = false;
+  Chess::PieceColor side = Chess::White;
+  int64_t since = 0;
+
+  void reset(int64_t base, int64_t inc){
+    remaining[Chess::Black] = remaining[Chess::White] = base;
+    increment = inc;
+    running = false;
+  }
+
+  void start(Chess::PieceColor color){
+    side = color;
+    since = milliseconds();
+    running = true;
+  }
+
+  // Stops the running side's clock and adds the increment
+  void punch(){
+    if(!running) return;
+    remaining[side] -= milliseconds() - since;
+    remaining[side] += increment;
+    running = false;
+  }
+
+  // Stops the clock without an increment, e.g. when the game is over
+  void halt(){
+    if(!running) return;
+    remaining[side] -= milliseconds() - since;
+    running = false;
+  }
+
+  int64_t timeLeft(Chess::PieceColor color){
+    if(running && color == side) return remaining[color] - (milliseconds() - since);
+    return remaining[color];
+  }
+
+  bool flagged(Chess::PieceColor color){return timeLeft(color) <= 0;}
+};
+
+// Splits the remaining time into a soft target (optimum) and a hard limit
+// (maximum). The target is stretched while the best move keeps changing or
+// the score drops, and shrunk once the best move has been stable.
+struct TimeManager{
+  std::atomic<int64_t> start{0};
+  std::atomic<int64_t> optimum{0};
+  std::atomic<int64_t> maximum{0};
+
+  // only touched by the search thread
+  double instability = 0;
+  bool hasPrevious = false;
+  Chess::Move previousBest;
+  int previousScore = 0;
+
+  // `bonus` is time already spent pondering on this very position
+  void allocate(int64_t remaining, int64_t increment, int64_t bonus = 0){
+    int64_t target = remaining / 30 + increment * 3 / 4;
+    target = std::max(target - bonus / 2, target / 4);
+    int64_t limit = std::min(remaining / 4, target * 4);
+    int64_t margin = std::max<int64_t>(remaining - 50, 1);
+    optimum = std::min(target, margin);
+    maximum = std::min(std::max(limit, target), margin);
+    start = milliseconds();
+  }
+
+  void resetStability(){
+    instability = 0;
+    hasPrevious = false;
+  }
+
+  // After each iteration, whether to stop instead of starting the next one
+  bool shouldStop(Engine::Search& search){
+    bool changed = hasPrevious && !(search.bestMove == previousBest);
+    int drop = hasPrevious ? previousScore - search.bestScore : 0;
+    instability = instability * 0.5 + (changed ? 1.0 : 0.0);
+
+    hasPrevious = true;
+    previousBest = search.bestMove;
+    previousScore = search.bestScore;
+
+    double factor = std::min(2.5, (0.6 + instability) * (drop > 30 ? 1.4 : 1.0));
+    // the next iteration usually costs more than all previous ones together
+    return milliseconds() - start > optimum * factor * 0.6;
+  }
+
+  bool overMaximum(){return milliseconds() - start > maximum;}
+};
+
+enum Mode{Idle, Think, Ponder};
+
+typedef struct{
+  uint64_t generation;
+  bool hasMove;      // false when the position has no legal move
+  Chess::Move move;
+  bool hasPonderMove;
+  Chess::Move ponderMove;
+  int score;
+  int depth;
+} Result;
+
+// Engine opponent. Thinks on its own move under the time manager, then
+// ponders on the position after the reply it expects. When the human plays
+// that reply the ponder search simply becomes the real search.
+struct Computer{
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  Chess::Board pending;
+  uint64_t generation = 0;
+  bool running = true;
+
+  std::atomic<int> mode{Idle};
+  std::atomic<bool> cancel{false};
+  Chess::Move predicted;
+  int64_t ponderStart = 0;
+  int maxDepth = 32;
+
+  TimeManager time;
+  Analysis::SpscQueue<Result, 8> results;
+
+  void start(){thread = std::thread(&Computer::loop, this);}
+
+  void post(Chess::Board& board, Mode newMode){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending = board;
+      generation++;
+      mode = newMode;
+      cancel = true;
+    }
+    wake.notify_one();
+  }
+
+  void think(Chess::Board& board, int64_t remaining, int64_t increment){
+    time.allocate(remaining, increment);
+    post(board, Think);
+  }
+
+  // `board` is the position after the computer's move, `reply` the expected answer
+  void ponder(Chess::Board& board, Chess::Move reply){
+    Chess::Board position = board;
+    position.makeMove(reply.piece, reply.to);
+    position.switchTurn();
+    predicted = reply;
+    ponderStart = milliseconds();
+    post(position, Ponder);
+  }
+
+  // Returns true if the running ponder search was on `move` and now counts as thinking
+  bool ponderHit(Chess::Move move, int64_t remaining, int64_t increment){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if(mode != Ponder || !(move == predicted)) return false;
+      time.allocate(remaining, increment, milliseconds() - ponderStart);
+      mode = Think;
+    }
+    wake.notify_one();
+    return true;
+  }
+
+  void idle(){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      generation++;
+      mode = Idle;
+      cancel = true;
+    }
+    wake.notify_one();
+  }
+
+  // Called from the UI loop: enforces the hard limit mid-iteration
+  void checkTime(){
+    if(mode == Think && time.overMaximum()) cancel = true;}
+
+  void stop(){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+      cancel = true;
+    }
+    wake.notify_one();
+    if(thread.joinable()) thread.join();
+  }
+
+  void loop(){
+    uint64_t seen = 0;
+    while(true){
+      Chess::Board board;
+      {
+	std::unique_lock<std::mutex> lock(mutex);
+	wake.wait(lock, [&]{return !running || (generation != seen && mode != Idle);});
+	if(!running) return;
+	board = pending;
+	seen = generation;
+	cancel = false;
+      }
+
+      Engine::Search search(board);
+      search.stop = &cancel;
+      time.resetStability();
+      search.onIteration = [&](Engine::Search& s){
+	if(mode == Think && time.shouldStop(s)) cancel = true;
+      };
+      search.run(maxDepth);
+
+      // a ponder search that ran out of depth waits for the hit or a new job
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]{return !running || generation != seen || mode != Ponder;});
+      if(!running || generation != seen || mode != Think) continue;
+
+      // always answer: stopped before depth 1 plays any legal move, none means mate or stalemate
+      Result result = {seen, search.hasBestMove, search.bestMove, false, {}, search.bestScore, search.completedDepth};
+      if(search.hasBestMove){
+	std::vector<Chess::Move> pv = search.principalVariation(2);
+	result.hasPonderMove = pv.size() > 1;
+	if(result.hasPonderMove) result.ponderMove = pv[1];
+      }else{
+	std::vector<Chess::Move> legal = board.legalMoves();
+	result.hasMove = !legal.empty();
+	if(result.hasMove) result.move = legal[0];
+      }
+      mode = Idle;
+      results.push(result);
+    }
+  }
+};
+
+}
+
+#endif
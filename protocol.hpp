@@ -0,0 +1,53 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <cstdint>
+
+// Wire format between server.cpp and its clients. Every request is one
+// fixed 16-byte record, every response a fixed 24-byte record followed by
+// `count` two-byte moves. Integers are in host byte order: the socket is a
+// local Unix socket, both ends run on the same machine.
+namespace Protocol{
+
+const char* DefaultSocketPath = "/tmp/chess-server.sock";
+
+enum Type : uint8_t{NewGame, Move, LegalMoves, Think, Close};
+
+// Full: no free game slot, or the game's worker is too far behind; retry later
+enum Status : uint8_t{Ok, Illegal, NoGame, Full, BadRequest};
+
+enum State : uint8_t{Ongoing, Check, Checkmate, Stalemate};
+
+typedef struct{
+  uint32_t id;       // echoed back, lets clients pipeline requests
+  uint32_t game;     // slot index | generation << 16, ignored by NewGame
+  uint32_t argument; // node budget for Think, capped by the server
+  uint8_t type;
+  uint8_t from;      // squares, x + 8*y
+  uint8_t to;
+  uint8_t reserved;
+} Request;
+
+typedef struct{
+  uint32_t id;
+  uint32_t game;
+  uint64_t hash;     // of the position after the request
+  uint8_t status;
+  uint8_t state;
+  uint8_t from;      // best move for Think
+  uint8_t to;
+  uint8_t count;     // moves following the record, LegalMoves only
+  uint8_t turn;
+  uint8_t reserved[2];
+} Response;
+
+typedef struct{
+  uint8_t from, to;
+} WireMove;
+
+static_assert(sizeof(Request) == 16, "Request must stay 16 bytes");
+static_assert(sizeof(Response) == 24, "Response must stay 24 bytes");
+
+}
+
+#endif
@@ -0,0 +1,548 @@
+// Headless game server: many boards in one process, driven over a Unix
+// domain socket with the records from protocol.hpp. One epoll thread reads
+// requests and hands them to a worker pool; every game belongs to exactly
+// one worker, so boards are never locked.
+//
+//   ./server --socket /tmp/chess-server.sock --threads 4 --games 4096
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "definitions.hpp"
+#include "chess.hpp"
+#include "engine.hpp"
+#include "analysis.hpp"
+#include "protocol.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+volatile std::sig_atomic_t running = 1;
+
+void onSignal(int){running = 0;}
+
+struct Settings{
+  std::string socketPath = Protocol::DefaultSocketPath;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  uint32_t games = 4096;
+  uint32_t defaultNodes = 2000;
+  uint32_t maxNodes = 200000; // cap on a client's Think budget
+  double statsInterval = 5;
+};
+
+/* ---------------- Arena ---------------- */
+
+// Boards live in one preallocated vector and are recycled through free
+// lists, a finished game costs no allocation for the next one. Slot i is
+// owned by worker i % threads and only that worker touches it.
+typedef struct{
+  Chess::Board board;
+  uint16_t generation;
+  bool used;
+} Slot;
+
+struct Arena{
+  std::vector<Slot> slots;
+
+  Arena(uint32_t capacity) : slots(capacity){
+    for(Slot& slot: slots){slot.generation = 0; slot.used = false;}
+  }
+
+  uint32_t gameId(uint32_t index){return index | ((uint32_t)slots[index].generation << 16);}
+
+  Slot* find(uint32_t game){
+    uint32_t index = game & 0xFFFF;
+    if(index >= slots.size()) return nullptr;
+    Slot& slot = slots[index];
+    if(!slot.used || slot.generation != (game >> 16)) return nullptr;
+    return &slot;
+  }
+};
+
+/* ---------------- Connections and workers ---------------- */
+
+const size_t MaxOutput = 16 << 20; // replies queued for a client that doesn't read
+
+// Closed once the epoll thread and every queued request are done with it.
+// Replies never block a worker: what the socket doesn't take right away
+// waits in `output` and is flushed by the epoll thread on EPOLLOUT.
+struct Connection{
+  int fd;
+  int epoll;
+  std::vector<uint8_t> input;
+
+  std::mutex mutex;
+  std::vector<uint8_t> output;
+  bool closed = false;
+  std::unordered_set<uint32_t> games; // opened and not closed yet, freed on disconnect
+
+  Connection(int fd, int epoll) : fd(fd), epoll(epoll){}
+  ~Connection(){close(fd);}
+
+  void watch(bool writable){
+    epoll_event event = {};
+    event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event);
+  }
+
+  // Writes what the socket takes, returns false once the peer is gone
+  bool writeSome(){
+    size_t offset = 0;
+    while(offset < output.size()){
+      ssize_t written = write(fd, output.data() + offset, output.size() - offset);
+      if(written > 0){offset += written; continue;}
+      if(written < 0 && errno == EINTR) continue;
+      if(written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+      output.erase(output.begin(), output.begin() + offset);
+      return false;
+    }
+    output.erase(output.begin(), output.begin() + offset);
+    return true;
+  }
+
+  // The epoll thread sees the shutdown as a hangup and releases the games
+  void drop(){
+    shutdown(fd, SHUT_RDWR);
+    closed = true;
+    output.clear();
+    output.shrink_to_fit();
+  }
+
+  void send(const void* data, size_t size){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(closed) return;
+    bool armed = !output.empty(); // EPOLLOUT is already waiting for the socket
+    output.insert(output.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+    if(!armed && !writeSome()){drop(); return;}
+    if(output.size() > MaxOutput){drop(); return;}
+    if(!armed && !output.empty()) watch(true);
+  }
+
+  // Called by the epoll thread on EPOLLOUT
+  bool flush(){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(!writeSome()) return false;
+    if(output.empty()) watch(false);
+    return true;
+  }
+
+  // Whether the game was recorded, false when the client is already gone
+  bool own(uint32_t game){
+    std::lock_guard<std::mutex> lock(mutex);
+    if(closed) return false;
+    games.insert(game);
+    return true;
+  }
+
+  void disown(uint32_t game){
+    std::lock_guard<std::mutex> lock(mutex);
+    games.erase(game);
+  }
+
+  // Marks the connection closed and hands back the games left open
+  std::vector<uint32_t> hangUp(){
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    output.clear();
+    std::vector<uint32_t> open(games.begin(), games.end());
+    games.clear();
+    return open;
+  }
+};
+
+typedef struct{
+  Protocol::Request request;
+  std::shared_ptr<Connection> connection;
+  Clock::time_point received;
+} Job;
+
+struct Worker{
+  int index;
+  Arena* arena;
+  Settings* settings;
+  std::vector<uint32_t> freeSlots;
+
+  Analysis::SpscQueue<Job, 4096> jobs;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  // microseconds from read to reply, drained by the stats report
+  std::mutex statsMutex;
+  std::vector<uint32_t> latencies;
+  uint64_t gamesFinished = 0;
+
+  std::thread thread;
+
+  void start(){thread = std::thread(&Worker::loop, this);}
+
+  // False when the queue is full, the epoll thread never waits on a worker
+  bool post(Job& job){
+    if(!jobs.push(job)) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    wake.notify_one();
+    return true;
+  }
+
+  void stop(){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+  }
+
+  void loop(){
+    std::vector<Protocol::WireMove> moves;
+    while(true){
+      Job job;
+      if(!jobs.pop(job)){
+	std::unique_lock<std::mutex> lock(mutex);
+	wake.wait(lock, [&](){return stopping || jobs.head != jobs.tail;});
+	if(stopping) return;
+	continue;
+      }
+
+      moves.clear();
+      Protocol::Response response = handle(job.request, *job.connection, moves);
+      if(moves.empty()) job.connection->send(&response, sizeof(response));
+      else{
+	std::vector<uint8_t> packet(sizeof(response) + moves.size() * sizeof(Protocol::WireMove));
+	std::memcpy(packet.data(), &response, sizeof(response));
+	std::memcpy(packet.data() + sizeof(response), moves.data(), moves.size() * sizeof(Protocol::WireMove));
+	job.connection->send(packet.data(), packet.size());
+      }
+
+      uint32_t micros = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - job.received).count();
+      std::lock_guard<std::mutex> lock(statsMutex);
+      latencies.push_back(micros);
+    }
+  }
+
+  Protocol::State state(Chess::Board& board){
+    bool check = board.isKingInCheck(board.turn);
+    if(!board.legalMoves().empty()) return check ? Protocol::Check : Protocol::Ongoing;
+    return check ? Protocol::Checkmate : Protocol::Stalemate;
+  }
+
+  void finishGame(){
+    std::lock_guard<std::mutex> lock(statsMutex);
+    gamesFinished++;
+  }
+
+  void release(Slot& slot, uint32_t index){
+    slot.used = false;
+    slot.generation++;
+    freeSlots.push_back(index);
+  }
+
+  Protocol::Response handle(Protocol::Request& request, Connection& connection, std::vector<Protocol::WireMove>& moves){
+    using namespace Protocol;
+    Response response = {request.id, request.game, 0, Ok, Ongoing, 0, 0, 0, 0, {0, 0}};
+
+    if(request.type == NewGame){
+      if(freeSlots.empty()){response.status = Full; return response;}
+      uint32_t index = freeSlots.back();
+      freeSlots.pop_back();
+
+      // the GUI's move maps are not needed here, so no Board::reset()
+      Slot& slot = arena->slots[index];
+      slot.used = true;
+      slot.board.pieces = Chess::initialPieces;
+      slot.board.turn = Chess::White;
+      slot.board.refreshAccumulator();
+      response.game = arena->gameId(index);
+      response.hash = slot.board.hash();
+      // the client hung up while the request was queued
+      if(!connection.own(response.game)) release(slot, index);
+      return response;
+    }
+
+    Slot* slot = arena->find(request.game);
+    if(!slot){response.status = NoGame; return response;}
+    Chess::Board& board = slot->board;
+
+    switch(request.type){
+    case Move:{
+      if(request.from >= 64 || request.to >= 64){response.status = BadRequest; break;}
+      SDL_Point from = {request.from % 8, request.from / 8}, to = {request.to % 8, request.to / 8};
+      bool legal = false;
+      for(Chess::Move& move: board.legalMoves())
+	if(move.piece.position == from && move.to == to){
+	  board.makeMove(move.piece, to);
+	  board.switchTurn();
+	  legal = true;
+	  break;
+	}
+      if(!legal){response.status = Illegal; break;}
+      response.state = state(board);
+      if(response.state == Checkmate || response.state == Stalemate) finishGame();
+      break;
+    }
+
+    case LegalMoves:
+      for(Chess::Move& move: board.legalMoves()){
+	if(moves.size() == 255) break;
+	moves.push_back({(uint8_t)Chess::square(move.piece.position), (uint8_t)Chess::square(move.to)});
+      }
+      response.count = moves.size();
+      response.state = board.isKingInCheck(board.turn) ? Check : Ongoing;
+      break;
+
+    case Think:{
+      Engine::Search search(board);
+      search.maxNodes = std::min(request.argument ? request.argument : settings->defaultNodes, settings->maxNodes);
+      search.run(Engine::MaxPly - 1);
+      if(!search.hasBestMove){response.state = state(board); break;}
+      response.from = Chess::square(search.bestMove.piece.position);
+      response.to = Chess::square(search.bestMove.to);
+      break;
+    }
+
+    case Close:
+      release(*slot, request.game & 0xFFFF);
+      connection.disown(request.game);
+      return response;
+
+    default:
+      response.status = BadRequest;
+    }
+
+    response.hash = board.hash();
+    response.turn = board.turn;
+    return response;
+  }
+};
+
+/* ---------------- Statistics ---------------- */
+
+uint32_t percentile(std::vector<uint32_t>& sorted, double p){
+  if(sorted.empty()) return 0;
+  return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+double cpuSeconds(){
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+struct Report{
+  Clock::time_point since = Clock::now();
+  double cpuSince = cpuSeconds();
+
+  void print(std::vector<std::unique_ptr<Worker>>& workers){
+    std::vector<uint32_t> latencies;
+    uint64_t games = 0;
+    for(auto& worker: workers){
+      std::lock_guard<std::mutex> lock(worker->statsMutex);
+      latencies.insert(latencies.end(), worker->latencies.begin(), worker->latencies.end());
+      worker->latencies.clear();
+      games += worker->gamesFinished;
+      worker->gamesFinished = 0;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    double elapsed = std::chrono::duration<double>(Clock::now() - since).count();
+    double cpu = cpuSeconds() - cpuSince;
+    since = Clock::now();
+    cpuSince += cpu;
+
+    std::cout << "requests/sec " << (uint64_t)(latencies.size() / elapsed)
+	      << "  p50 " << percentile(latencies, 0.50) << " us"
+	      << "  p99 " << percentile(latencies, 0.99) << " us"
+	      << "  games/sec " << games / elapsed
+	      << "  cores busy " << cpu / elapsed
+	      << "  games per core-sec " << (cpu > 0 ? games / cpu : 0) << std::endl;
+  }
+};
+
+/* ---------------- Event loop ---------------- */
+
+bool parseArguments(int argc, char** argv, Settings& settings){
+  for(int i = 1; i < argc; i++){
+    std::string arg = argv[i];
+    if(i + 1 >= argc){std::cerr << "Missing value for " << arg << "\n"; return false;}
+    std::string value = argv[++i];
+
+    if(arg == "--socket") settings.socketPath = value;
+    else if(arg == "--threads") settings.threads = std::max(1, std::stoi(value));
+    else if(arg == "--games") settings.games = std::min(65536ul, std::max(1ul, std::stoul(value)));
+    else if(arg == "--nodes") settings.defaultNodes = std::stoul(value);
+    else if(arg == "--max-nodes") settings.maxNodes = std::max(1ul, std::stoul(value));
+    else if(arg == "--stats") settings.statsInterval = std::stod(value);
+    else{std::cerr << "Unknown option " << arg << "\n"; return false;}
+  }
+  return true;
+}
+
+int listenOn(std::string path){
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(path.c_str());
+  if(fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 128) != 0){
+    std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv){
+  Settings settings;
+  if(!parseArguments(argc, argv, settings)) return 1;
+
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  int listener = listenOn(settings.socketPath);
+  if(listener < 0) return 1;
+
+  Arena arena(settings.games);
+  std::vector<std::unique_ptr<Worker>> workers;
+  for(int i = 0; i < settings.threads; i++){
+    workers.emplace_back(new Worker());
+    workers.back()->index = i;
+    workers.back()->arena = &arena;
+    workers.back()->settings = &settings;
+  }
+  for(uint32_t index = settings.games; index-- > 0;)
+    workers[index % settings.threads]->freeSlots.push_back(index);
+  for(auto& worker: workers) worker->start();
+
+  int epoll = epoll_create1(0);
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = listener;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+
+  std::cout << "Listening on " << settings.socketPath << " with " << settings.threads
+	    << " workers and " << settings.games << " game slots" << std::endl;
+
+  std::unordered_map<int, std::shared_ptr<Connection>> connections;
+  size_t nextWorker = 0;
+  Report report;
+  epoll_event events[64];
+  std::vector<Job> deferred; // Close jobs for dropped connections
+  uint8_t buffer[1 << 16];
+
+  while(running){
+    // releases that found their worker's queue full are retried soon
+    for(size_t i = 0; i < deferred.size();){
+      Job& job = deferred[i];
+      if(workers[(job.request.game & 0xFFFF) % workers.size()]->post(job)){
+	deferred[i] = std::move(deferred.back());
+	deferred.pop_back();
+      }else i++;
+    }
+
+    int ready = epoll_wait(epoll, events, 64, deferred.empty() ? 250 : 1);
+
+    for(int e = 0; e < ready; e++){
+      int fd = events[e].data.fd;
+
+      if(fd == listener){
+	int client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+	if(client < 0) continue;
+	connections[client] = std::make_shared<Connection>(client, epoll);
+	epoll_event clientEvent = {};
+	clientEvent.events = EPOLLIN;
+	clientEvent.data.fd = client;
+	epoll_ctl(epoll, EPOLL_CTL_ADD, client, &clientEvent);
+	continue;
+      }
+
+      auto found = connections.find(fd);
+      if(found == connections.end()) continue;
+      std::shared_ptr<Connection> connection = found->second;
+
+      bool alive = true;
+      if(events[e].events & EPOLLOUT) alive = connection->flush();
+
+      // level triggered, one read per wakeup is enough
+      ssize_t received = 0;
+      if(alive && (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))){
+	received = read(fd, buffer, sizeof(buffer));
+	if(received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) received = -2;
+	if(received == 0 || received == -1) alive = false;
+      }
+
+      if(!alive){
+	// games the client left open go back to their workers' free lists
+	for(uint32_t game: connection->hangUp()){
+	  Job job;
+	  job.request = {};
+	  job.request.type = Protocol::Close;
+	  job.request.game = game;
+	  job.connection = connection;
+	  job.received = Clock::now();
+	  if(!workers[(game & 0xFFFF) % workers.size()]->post(job)) deferred.push_back(std::move(job));
+	}
+	epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+	connections.erase(found);
+	continue;
+      }
+      if(received <= 0) continue;
+
+      Clock::time_point now = Clock::now();
+      std::vector<uint8_t>& input = connection->input;
+      input.insert(input.end(), buffer, buffer + received);
+
+      size_t offset = 0;
+      for(; offset + sizeof(Protocol::Request) <= input.size(); offset += sizeof(Protocol::Request)){
+	Job job;
+	std::memcpy(&job.request, input.data() + offset, sizeof(Protocol::Request));
+	job.connection = connection;
+	job.received = now;
+
+	// a game's requests always go to the worker owning its slot
+	size_t target = (job.request.type == Protocol::NewGame)
+	  ? nextWorker++ % workers.size()
+	  : (job.request.game & 0xFFFF) % workers.size();
+	if(workers[target]->post(job)) continue;
+
+	// a backed up worker turns requests away instead of stalling everyone
+	Protocol::Response busy = {job.request.id, job.request.game, 0, Protocol::Full,
+				   Protocol::Ongoing, 0, 0, 0, 0, {0, 0}};
+	connection->send(&busy, sizeof(busy));
+      }
+      input.erase(input.begin(), input.begin() + offset);
+    }
+
+    if(std::chrono::duration<double>(Clock::now() - report.since).count() >= settings.statsInterval)
+      report.print(workers);
+  }
+
+  std::cout << "\nShutting down" << std::endl;
+  report.print(workers);
+  for(auto& worker: workers) worker->stop();
+  connections.clear();
+  close(epoll);
+  close(listener);
+  unlink(settings.socketPath.c_str());
+  return 0;
+}
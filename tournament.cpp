@@ -0,0 +1,402 @@
+// Headless engine-vs-engine match: baseline (A) against candidate (B), one
+// game per thread, each opening played with both colors. Stops as soon as
+// the SPRT reaches a verdict and reports Elo for B.
+//
+// Either side is the engine built into this binary or, with --engine-a/-b,
+// a separately built engine speaking the UCI subset of uci.cpp, so a change
+// to the search itself can be tested against the build without it.
+//
+//   ./tournament --openings book.epd --nodes 2000 --engine-b ../candidate/uci --pgn games.pgn
+
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "definitions.hpp"
+#include "chess.hpp"
+#include "engine.hpp"
+#include "notation.hpp"
+
+const int MAX_PLIES = 300;
+
+struct EngineConfig{
+  std::string name;
+  std::string command = ""; // external engine, empty for the built-in one
+  NNUE::Network* network = nullptr;
+  uint64_t nodes = 2000;
+  int64_t moveTime = 0;
+};
+
+struct Settings{
+  std::string openingsPath;
+  std::string pgnPath;
+  int maxGames = 20000;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  double elo0 = 0, elo1 = 5, alpha = 0.05, beta = 0.05;
+  EngineConfig a = {"baseline"}, b = {"candidate"};
+};
+
+enum Outcome{WhiteWins, BlackWins, Draw};
+
+typedef struct{
+  Outcome outcome;
+  std::string reason;
+  std::vector<std::string> moves;
+} PlayedGame;
+
+/* ---------------- Players ---------------- */
+
+// A child process with its stdin and stdout on pipes
+struct Process{
+  pid_t pid = -1;
+  FILE* input = nullptr;  // the child's stdin
+  FILE* output = nullptr; // the child's stdout
+
+  bool start(const std::string& command){
+    int toChild[2], fromChild[2];
+    if(pipe(toChild) < 0) return false;
+    if(pipe(fromChild) < 0){close(toChild[0]); close(toChild[1]); return false;}
+
+    pid = fork();
+    if(pid == 0){
+      dup2(toChild[0], STDIN_FILENO);
+      dup2(fromChild[1], STDOUT_FILENO);
+      close(toChild[0]); close(toChild[1]); close(fromChild[0]); close(fromChild[1]);
+      execl("/bin/sh", "sh", "-c", command.c_str(), (char*)nullptr);
+      _exit(127);
+    }
+    close(toChild[0]);
+    close(fromChild[1]);
+    if(pid < 0){close(toChild[1]); close(fromChild[0]); return false;}
+    input = fdopen(toChild[1], "w");
+    output = fdopen(fromChild[0], "r");
+    return input && output;
+  }
+
+  ~Process(){
+    if(input){send("quit"); fclose(input);}
+    if(output) fclose(output);
+    if(pid > 0) waitpid(pid, nullptr, 0);
+  }
+
+  void send(const std::string& line){
+    fputs((line + "\n").c_str(), input);
+    fflush(input);
+  }
+
+  bool readLine(std::string& line){
+    char buffer[4096];
+    if(!fgets(buffer, sizeof(buffer), output)) return false;
+    line = buffer;
+    while(!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+    return true;
+  }
+
+  // Reads lines until one starts with `prefix`
+  bool expect(const std::string& prefix, std::string& line){
+    while(readLine(line))
+      if(line.compare(0, prefix.size(), prefix) == 0) return true;
+    return false;
+  }
+};
+
+// One side of the match as seen from one worker thread. External engines
+// are started once per thread and reused for every game it plays.
+struct Player{
+  EngineConfig& config;
+  Process process;
+  bool ready = true;
+
+  Player(EngineConfig& config) : config(config){
+    if(config.command.empty()) return;
+    std::string line;
+    ready = process.start(config.command);
+    if(ready){
+      process.send("uci");
+      ready = process.expect("uciok", line);
+    }
+  }
+
+  // False when an external engine died or answered with an illegal move.
+  // `position` is the UCI position command reaching `board`, the opening
+  // plus every move, so both engines see the same piece order.
+  bool choose(Chess::Board& board, std::vector<Chess::Move>& legal, std::string& position, Chess::Move& move){
+    if(config.command.empty()){
+      board.setNetwork(config.network);
+      Engine::Search search(board);
+      search.maxNodes = config.nodes;
+      search.maxMilliseconds = config.moveTime;
+      search.run(Engine::MaxPly - 1);
+      move = search.hasBestMove ? search.bestMove : legal[0];
+      return true;
+    }
+
+    if(!ready) return false;
+    std::string go = "go nodes " + std::to_string(config.nodes);
+    if(config.moveTime) go += " movetime " + std::to_string(config.moveTime);
+    process.send(position);
+    process.send(go);
+
+    std::string line;
+    if(!process.expect("bestmove ", line)){ready = false; return false;}
+    std::string name = line.substr(9, line.find(' ', 9) - 9);
+    for(auto& candidate: legal)
+      if(Chess::moveName(candidate) == name){move = candidate; return true;}
+    return false;
+  }
+};
+
+PlayedGame playGame(std::string& fen, Player& white, Player& black){
+  PlayedGame game = {Draw, "max plies", {}};
+  std::map<uint64_t, int> repetitions;
+  Chess::Board board;
+  Notation::loadFen(board, fen);
+  std::string position = "position fen " + fen + " moves";
+
+  for(int ply = 0; ply < MAX_PLIES; ply++){
+    std::vector<Chess::Move> legal = board.legalMoves();
+    if(legal.empty()){
+      if(board.isKingInCheck(board.turn)){
+	game.outcome = (board.turn == Chess::White) ? BlackWins : WhiteWins;
+	game.reason = "checkmate";
+      }else game.reason = "stalemate";
+      return game;
+    }
+    if(board.pieces.size() == 2){game.reason = "insufficient material"; return game;}
+    if(++repetitions[board.hash()] >= 3){game.reason = "repetition"; return game;}
+
+    Player& player = (board.turn == Chess::White) ? white : black;
+    Chess::Move move;
+    if(!player.choose(board, legal, position, move)){
+      game.outcome = (board.turn == Chess::White) ? BlackWins : WhiteWins;
+      game.reason = player.config.name + " forfeits (no legal move from the engine)";
+      return game;
+    }
+
+    game.moves.push_back(Notation::san(board, move));
+    position += " " + Chess::moveName(move);
+    board.makeMove(move.piece, move.to);
+    board.switchTurn();
+  }
+  return game;
+}
+
+std::string pgn(PlayedGame& game, int round, std::string& white, std::string& black, std::string& fen, bool blackStarts){
+  const char* result = (game.outcome == WhiteWins) ? "1-0" : ((game.outcome == BlackWins) ? "0-1" : "1/2-1/2");
+  std::string text =
+    "[Event \"Self-play\"]\n[Site \"local\"]\n[Round \"" + std::to_string(round) + "\"]\n" +
+    "[White \"" + white + "\"]\n[Black \"" + black + "\"]\n[Result \"" + result + "\"]\n" +
+    "[SetUp \"1\"]\n[FEN \"" + fen + "\"]\n[Termination \"" + game.reason + "\"]\n\n";
+
+  std::string line;
+  for(size_t i = 0; i < game.moves.size(); i++){
+    size_t ply = i + (blackStarts ? 1 : 0);
+    std::string token;
+    if(ply % 2 == 0) token = std::to_string(ply / 2 + 1) + ". ";
+    else if(i == 0) token = std::to_string(ply / 2 + 1) + "... ";
+    token += game.moves[i] + " ";
+    if(line.size() + token.size() > 80){text += line + "\n"; line.clear();}
+    line += token;
+  }
+  return text + line + result + "\n\n";
+}
+
+/* ---------------- Statistics ---------------- */
+
+struct Score{
+  int wins = 0, draws = 0, losses = 0; // from B's point of view
+
+  int games(){return wins + draws + losses;}
+
+  double mean(){return (wins + 0.5 * draws) / games();}
+
+  double drawRate(){return (double)draws / games();}
+
+  // per-game variance of the score
+  double variance(){
+    double n = games(), m = mean();
+    return (wins + 0.25 * draws) / n - m * m;
+  }
+};
+
+double eloToScore(double elo){return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));}
+
+double scoreToElo(double score){
+  score = std::min(std::max(score, 1e-6), 1.0 - 1e-6);
+  return 400.0 * std::log10(score / (1.0 - score));
+}
+
+// Most likely win/draw/loss probabilities with expected score `target`,
+// given the observed frequencies: q[i] = p[i] / (1 + lambda * (x[i] - target))
+// with lambda found by bisection. The draw rate is carried over from the
+// data instead of being assumed.
+void constrainedFit(const double p[3], double target, double q[3]){
+  const double x[3] = {1.0, 0.5, 0.0};
+  // every denominator stays positive inside (low, high)
+  double low = -1.0 / (x[0] - target), high = 1.0 / (target - x[2]);
+  for(int i = 0; i < 100; i++){
+    double lambda = (low + high) / 2, slope = 0;
+    for(int k = 0; k < 3; k++) slope += p[k] * (x[k] - target) / (1 + lambda * (x[k] - target));
+    if(slope > 0) low = lambda; else high = lambda;
+  }
+  double lambda = (low + high) / 2;
+  for(int k = 0; k < 3; k++) q[k] = p[k] / (1 + lambda * (x[k] - target));
+}
+
+// Log-likelihood ratio of elo1 against elo0 for the trinomial (win, draw,
+// loss) model. Outcomes never seen get a tiny count so a run of nothing but
+// draws still moves the ratio, towards H0.
+double llr(Score& score, double elo0, double elo1){
+  int n = score.games();
+  if(n == 0) return 0;
+  double counts[3] = {(double)score.wins, (double)score.draws, (double)score.losses};
+  double total = 0, p[3], q0[3], q1[3];
+  for(double& count: counts){if(count == 0) count = 1e-3; total += count;}
+  for(int k = 0; k < 3; k++) p[k] = counts[k] / total;
+
+  constrainedFit(p, eloToScore(elo0), q0);
+  constrainedFit(p, eloToScore(elo1), q1);
+  double ratio = 0;
+  for(int k = 0; k < 3; k++) ratio += p[k] * std::log(q1[k] / q0[k]);
+  return n * ratio;
+}
+
+/* ---------------- Match ---------------- */
+
+std::vector<std::string> readOpenings(std::string path){
+  std::vector<std::string> openings;
+  if(path.empty()) return openings;
+  std::ifstream file(path);
+  std::string line;
+  Chess::Board board;
+  while(std::getline(file, line))
+    if(!line.empty() && line[0] != '#' && Notation::loadFen(board, line)) openings.push_back(line);
+  return openings;
+}
+
+bool parseArguments(int argc, char** argv, Settings& settings){
+  for(int i = 1; i < argc; i++){
+    std::string arg = argv[i];
+    if(i + 1 >= argc){std::cerr << "Missing value for " << arg << "\n"; return false;}
+    std::string value = argv[++i];
+
+    if(arg == "--openings") settings.openingsPath = value;
+    else if(arg == "--pgn") settings.pgnPath = value;
+    else if(arg == "--games") settings.maxGames = std::stoi(value);
+    else if(arg == "--threads") settings.threads = std::max(1, std::stoi(value));
+    else if(arg == "--nodes") settings.a.nodes = settings.b.nodes = std::stoull(value);
+    else if(arg == "--movetime") settings.a.moveTime = settings.b.moveTime = std::stoll(value);
+    else if(arg == "--nodes-a") settings.a.nodes = std::stoull(value);
+    else if(arg == "--nodes-b") settings.b.nodes = std::stoull(value);
+    else if(arg == "--net-a") settings.a.network = NNUE::load(value);
+    else if(arg == "--net-b") settings.b.network = NNUE::load(value);
+    else if(arg == "--engine-a") settings.a.command = value;
+    else if(arg == "--engine-b") settings.b.command = value;
+    else if(arg == "--elo0") settings.elo0 = std::stod(value);
+    else if(arg == "--elo1") settings.elo1 = std::stod(value);
+    else if(arg == "--alpha") settings.alpha = std::stod(value);
+    else if(arg == "--beta") settings.beta = std::stod(value);
+    else{std::cerr << "Unknown option " << arg << "\n"; return false;}
+  }
+  return true;
+}
+
+int main(int argc, char** argv){
+  Settings settings;
+  if(!parseArguments(argc, argv, settings)) return 1;
+  signal(SIGPIPE, SIG_IGN); // a dead engine loses its game, not the match
+
+  for(EngineConfig* config: {&settings.a, &settings.b}){
+    if(config->command.empty()) continue;
+    Player probe(*config);
+    if(!probe.ready){std::cerr << "Engine " << config->name << " (" << config->command << ") doesn't speak UCI\n"; return 1;}
+  }
+
+  std::vector<std::string> openings = readOpenings(settings.openingsPath);
+  Chess::Board initial;
+  if(openings.empty()) openings.push_back(Notation::fen(initial));
+
+  double lowerBound = std::log(settings.beta / (1 - settings.alpha));
+  double upperBound = std::log((1 - settings.beta) / settings.alpha);
+
+  std::mutex mutex;
+  std::atomic<int> nextGame{0};
+  std::atomic<bool> finished{false};
+  Score score;
+  std::string verdict = "none";
+  std::ofstream pgnFile;
+  if(!settings.pgnPath.empty()) pgnFile.open(settings.pgnPath);
+
+  auto startTime = std::chrono::steady_clock::now();
+
+  auto worker = [&](){
+    Player a(settings.a), b(settings.b);
+    while(!finished){
+      int index = nextGame++;
+      if(index >= settings.maxGames) return;
+
+      // each opening twice, B takes white on odd games
+      std::string fen = openings[(index / 2) % openings.size()];
+      bool candidateWhite = index % 2;
+      Player& white = candidateWhite ? b : a;
+      Player& black = candidateWhite ? a : b;
+
+      Chess::Board board;
+      Notation::loadFen(board, fen);
+      PlayedGame game = playGame(fen, white, black);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if(finished) return;
+      if(game.outcome == Draw) score.draws++;
+      else if((game.outcome == WhiteWins) == candidateWhite) score.wins++;
+      else score.losses++;
+
+      if(pgnFile) pgnFile << pgn(game, index + 1, white.config.name, black.config.name, fen, board.turn == Chess::Black);
+
+      double ratio = llr(score, settings.elo0, settings.elo1);
+      if(ratio >= upperBound){verdict = "H1 accepted (candidate is stronger)"; finished = true;}
+      if(ratio <= lowerBound){verdict = "H0 accepted (no gain)"; finished = true;}
+
+      if(score.games() % 10 == 0 || finished)
+	std::cout << "games " << score.games() << "  +" << score.wins << " =" << score.draws
+		  << " -" << score.losses << "  draws " << (int)(100 * score.drawRate()) << "%  LLR " << ratio
+		  << " [" << lowerBound << ", " << upperBound << "]" << std::endl;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for(int i = 0; i < settings.threads; i++) threads.emplace_back(worker);
+  for(auto& thread: threads) thread.join();
+
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  int games = score.games();
+  if(games == 0){std::cout << "No games played\n"; return 1;}
+  if(verdict == "none") verdict = "inconclusive (game limit reached with the LLR inside the bounds)";
+
+  double margin = 1.96 * std::sqrt(score.variance() / games);
+  double elo = scoreToElo(score.mean());
+  double eloLow = scoreToElo(score.mean() - margin), eloHigh = scoreToElo(score.mean() + margin);
+
+  std::cout << "\nGames: " << games << " (+" << score.wins << " =" << score.draws << " -" << score.losses << ")\n"
+	    << "Elo: " << elo << " +/- " << (eloHigh - eloLow) / 2
+	    << " (95%: " << eloLow << " .. " << eloHigh << ")\n"
+	    << "Draw rate: " << score.drawRate() << "\n"
+	    << "LLR: " << llr(score, settings.elo0, settings.elo1)
+	    << " for elo0=" << settings.elo0 << " elo1=" << settings.elo1 << "\n"
+	    << "SPRT: " << verdict << "\n"
+	    << "Games/sec: " << games / elapsed << " on " << settings.threads << " threads\n";
+  return 0;
+}
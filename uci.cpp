@@ -0,0 +1,85 @@
+// The engine as a standalone process, speaking the small subset of UCI the
+// tournament needs. Build a candidate from another checkout and point
+// `tournament --engine-b` at it to compare two separately built engines.
+//
+//   uci / isready / ucinewgame / quit
+//   position fen <fen> [moves e2e4 ...]    (or: position startpos [moves ...])
+//   go [nodes N] [movetime MS]             -> bestmove e2e4 (0000 without a move)
+//
+//   ./uci --net weights.nnue
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+
+#include "definitions.hpp"
+#include "chess.hpp"
+#include "engine.hpp"
+#include "notation.hpp"
+
+bool playMove(Chess::Board& board, const std::string& name){
+  for(auto& move: board.legalMoves()){
+    if(Chess::moveName(move) != name) continue;
+    board.makeMove(move.piece, move.to);
+    board.switchTurn();
+    return true;
+  }
+  return false;
+}
+
+bool setPosition(Chess::Board& board, std::istringstream& in){
+  std::string word, fen;
+  in >> word;
+  if(word == "startpos") board.reset();
+  else if(word == "fen"){
+    while(in >> word && word != "moves") fen += word + " ";
+    if(!Notation::loadFen(board, fen)) return false;
+  }else return false;
+
+  if(word != "moves") in >> word;
+  while(in >> word)
+    if(!playMove(board, word)) return false;
+  return true;
+}
+
+int main(int argc, char** argv){
+  NNUE::Network* network = nullptr;
+  for(int i = 1; i + 1 < argc; i += 2){
+    std::string arg = argv[i];
+    if(arg == "--net") network = NNUE::load(argv[i + 1]);
+    else{std::cerr << "Unknown option " << arg << "\n"; return 2;}
+  }
+
+  Chess::Board board;
+  board.setNetwork(network);
+  std::string line;
+  while(std::getline(std::cin, line)){
+    std::istringstream in(line);
+    std::string command;
+    in >> command;
+
+    if(command == "uci") std::cout << "id name simple-chess\nuciok" << std::endl;
+    else if(command == "isready") std::cout << "readyok" << std::endl;
+    else if(command == "ucinewgame") board.reset();
+    else if(command == "position"){
+      if(!setPosition(board, in)) std::cerr << "Bad position: " << line << std::endl;
+    }else if(command == "go"){
+      Engine::Search search(board);
+      std::string option;
+      while(in >> option){
+	if(option == "nodes") in >> search.maxNodes;
+	else if(option == "movetime") in >> search.maxMilliseconds;
+      }
+      search.run(Engine::MaxPly - 1);
+
+      std::vector<Chess::Move> legal = board.legalMoves();
+      if(search.hasBestMove) std::cout << "bestmove " << Chess::moveName(search.bestMove) << std::endl;
+      else if(!legal.empty()) std::cout << "bestmove " << Chess::moveName(legal[0]) << std::endl;
+      else std::cout << "bestmove 0000" << std::endl;
+    }else if(command == "quit") break;
+  }
+  return 0;
+}